@@ -0,0 +1,22 @@
+# add_formula_header(<target> INPUT <formulas file> OUTPUT <header name> NAMESPACE <namespace>)
+# Generates header with C++ functions for formulas of the file at build time and makes it available to the target.
+# The header is regenerated when the formulas file or the generator changes.
+function(add_formula_header target)
+    cmake_parse_arguments(FORMULA "" "INPUT;OUTPUT;NAMESPACE" "" ${ARGN})
+    if (NOT FORMULA_INPUT OR NOT FORMULA_OUTPUT OR NOT FORMULA_NAMESPACE)
+        message(FATAL_ERROR "add_formula_header requires INPUT, OUTPUT and NAMESPACE")
+    endif()
+    get_filename_component(input "${FORMULA_INPUT}" ABSOLUTE)
+    set(directory "${CMAKE_CURRENT_BINARY_DIR}/generated")
+    set(output "${directory}/${FORMULA_OUTPUT}")
+    add_custom_command(
+        OUTPUT "${output}"
+        COMMAND ${CMAKE_COMMAND} -E make_directory "${directory}"
+        COMMAND FormulaCodegen "${input}" "${output}" "${FORMULA_NAMESPACE}"
+        DEPENDS "${input}" FormulaCodegen
+        COMMENT "Generating formulas ${FORMULA_OUTPUT}"
+        VERBATIM
+    )
+    target_sources(${target} PRIVATE "${output}")
+    target_include_directories(${target} PRIVATE "${directory}")
+endfunction()
@@ -0,0 +1,122 @@
+#include "adaptive.hpp"
+
+#include <bit>
+#include <chrono>
+#include <mutex>
+
+namespace parser {
+
+std::string_view to_string(backend b) {
+    switch (b) {
+    case backend::interpreted:
+        return "interpreted";
+    case backend::batch:
+        return "batch";
+    case backend::multithreaded:
+        return "multithreaded";
+    }
+    return "unknown";
+}
+
+adaptive_evaluator::adaptive_evaluator(MathParser formula, std::size_t threads, std::size_t sample_rows)
+    : _formula(std::move(formula)), _threads(threads), _sample_rows(std::max<std::size_t>(sample_rows, 1)) {}
+
+void adaptive_evaluator::evaluate(const std::span<const std::span<const double>> columns, const std::span<double> out) {
+    const std::size_t rows = out.size();
+    check_columns(columns, rows);
+    if (rows == 0)
+        return;
+    if (const auto cached = choice(rows)) {
+        evaluate(*cached, columns, out);
+        return;
+    }
+    const decision made = sample(columns, out, rows);
+    {
+        std::unique_lock lock(_mutex);
+        _decisions.try_emplace(made.bucket, made);
+    }
+    // leading rows are already computed by sampling
+    const std::size_t sampled = made.sampled_rows;
+    if (sampled < rows) {
+        std::vector<std::span<const double>> rest(columns.begin(), columns.end());
+        for (auto& column : rest)
+            column = column.subspan(sampled);
+        evaluate(made.choice, std::span<const std::span<const double>>(rest), out.subspan(sampled));
+    }
+}
+
+void adaptive_evaluator::evaluate(backend b, const std::span<const std::span<const double>> columns, const std::span<double> out) const {
+    check_columns(columns, out.size());
+    switch (b) {
+    case backend::interpreted: {
+        std::vector<double> row(columns.size());
+        for (std::size_t i = 0; i < out.size(); ++i) {
+            for (std::size_t j = 0; j < columns.size(); ++j)
+                row[j] = columns[j][i];
+            out[i] = _formula(std::span<const double>(row));
+        }
+        break;
+    }
+    case backend::batch:
+        _formula.evaluate_batch(columns, out, 1);
+        break;
+    case backend::multithreaded:
+        _formula.evaluate_batch(columns, out, _threads);
+        break;
+    }
+}
+
+std::optional<backend> adaptive_evaluator::choice(std::size_t rows) const {
+    std::shared_lock lock(_mutex);
+    const auto it = _decisions.find(bucket(rows));
+    if (it == _decisions.end())
+        return std::nullopt;
+    return it->second.choice;
+}
+
+std::vector<adaptive_evaluator::decision> adaptive_evaluator::decisions() const {
+    std::shared_lock lock(_mutex);
+    std::vector<decision> res;
+    for (const auto& [_, made] : _decisions)
+        res.push_back(made);
+    return res;
+}
+
+const MathParser& adaptive_evaluator::formula() const {
+    return _formula;
+}
+
+void adaptive_evaluator::check_columns(const std::span<const std::span<const double>> columns, std::size_t rows) const {
+    if (columns.size() != _formula.variables_count())
+        throw std::domain_error{"Wrong number of columns."};
+    for (const auto& column : columns)
+        if (column.size() < rows)
+            throw std::domain_error{"Wrong number of rows. Every column must contain at least as many values as output."};
+}
+
+std::size_t adaptive_evaluator::bucket(std::size_t rows) {
+    return rows == 0 ? 0 : std::bit_width(rows) - 1;
+}
+
+std::size_t adaptive_evaluator::sample_size(std::size_t rows) const {
+    return std::min(rows, std::max(_sample_rows, rows / sample_fraction));
+}
+
+adaptive_evaluator::decision adaptive_evaluator::sample(const std::span<const std::span<const double>> columns, const std::span<double> out, std::size_t rows) const {
+    const std::size_t sampled = sample_size(rows);
+    std::vector<std::span<const double>> leading(columns.begin(), columns.end());
+    for (auto& column : leading)
+        column = column.first(sampled);
+    decision made{bucket(rows), sampled, backend::interpreted, {}};
+    for (std::size_t b = 0; b < backends_count; ++b) {
+        const auto start = std::chrono::steady_clock::now();
+        evaluate(static_cast<backend>(b), std::span<const std::span<const double>>(leading), out.first(sampled));
+        const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        made.nanoseconds_per_row[b] = elapsed.count() / double(sampled);
+        if (made.nanoseconds_per_row[b] < made.nanoseconds_per_row[static_cast<std::size_t>(made.choice)])
+            made.choice = static_cast<backend>(b);
+    }
+    return made;
+}
+
+}
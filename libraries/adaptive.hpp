@@ -0,0 +1,67 @@
+#pragma once
+
+#include "parser.hpp"
+
+#include <array>
+#include <map>
+#include <optional>
+#include <shared_mutex>
+#include <string_view>
+#include <vector>
+
+// Chooses execution strategy of formula by timing. The first batch of every size bucket (rows rounded down to
+// a power of two) runs every candidate on its leading rows, the fastest one is cached and used for the following
+// batches of the bucket. Rows evaluated during sampling are not computed again. The sample grows with the batch,
+// so that thread start of the multithreaded backend is weighed against a comparable amount of work. Backends give
+// bitwise equal results, the choice affects only speed.
+namespace parser {
+
+enum class backend : std::size_t {
+    interpreted, // row by row evaluation of the tape
+    batch,       // block evaluation in the calling thread
+    multithreaded
+};
+inline constexpr std::size_t backends_count = 3;
+
+std::string_view to_string(backend b);
+
+class adaptive_evaluator {
+public:
+    struct decision {
+        // batches with rows in [2^bucket, 2^(bucket + 1))
+        std::size_t bucket;
+        // rows every backend was timed on
+        std::size_t sampled_rows;
+        backend choice;
+        // measured time of every backend, indexed by backend
+        std::array<double, backends_count> nanoseconds_per_row;
+    };
+
+    // threads are used by multithreaded backend, 0 means all hardware threads. Batches sample sample_rows or
+    // 1 / sample_fraction of their rows, whichever is larger.
+    static constexpr std::size_t sample_fraction = 16;
+    explicit adaptive_evaluator(MathParser formula, std::size_t threads = 0, std::size_t sample_rows = 1 << 14);
+
+    void evaluate(const std::span<const std::span<const double>> columns, const std::span<double> out);
+    void evaluate(backend b, const std::span<const std::span<const double>> columns, const std::span<double> out) const;
+
+    // Cached choice for batch of rows, if it was already made.
+    std::optional<backend> choice(std::size_t rows) const;
+    std::vector<decision> decisions() const;
+    const MathParser& formula() const;
+
+private:
+    static std::size_t bucket(std::size_t rows);
+    std::size_t sample_size(std::size_t rows) const;
+    // Columns are validated before any of them is sliced.
+    void check_columns(const std::span<const std::span<const double>> columns, std::size_t rows) const;
+    decision sample(const std::span<const std::span<const double>> columns, const std::span<double> out, std::size_t rows) const;
+
+    MathParser _formula;
+    std::size_t _threads;
+    std::size_t _sample_rows;
+    mutable std::shared_mutex _mutex;
+    std::map<std::size_t, decision> _decisions;
+};
+
+}
@@ -0,0 +1,274 @@
+#pragma once
+
+#include "program.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Batch evaluation of compiled program over columnar data: columns[j][i] is the value of variable j in row i.
+// Rows are evaluated in blocks, every instruction is applied to the whole block at once. Rows are split into chunks
+// of fixed size which threads take in any order, partial results are stored per chunk and combined in chunk order,
+// so results do not depend on number of threads.
+namespace parser {
+
+template<typename T>
+class block_evaluator {
+public:
+    static constexpr std::size_t block_size = 256;
+
+    explicit block_evaluator(const program& compiled)
+        : _program(compiled), _workspace(compiled.size() * block_size), _operands(compiled.size(), nullptr), _levels(compiled.levels()) {
+        // constant subexpressions are computed once for all blocks
+        const auto& code = _program.code();
+        for (std::size_t i = 0; i < code.size(); ++i)
+            if (_levels[i] == 0)
+                compute(i, std::span<const std::span<const T>>(), 0, block_size);
+    }
+
+    // Evaluates rows [first, first + count), count <= block_size. Returned pointer is valid until the next call.
+    const T* operator()(const std::span<const std::span<const T>> columns, std::size_t first, std::size_t count) {
+        const auto& code = _program.code();
+        for (std::size_t i = 0; i < code.size(); ++i)
+            if (_levels[i] != 0)
+                compute(i, columns, first, count);
+        return _operands.back();
+    }
+
+private:
+    template<class F>
+    static void transform(T* res, std::size_t count, F f) {
+        for (std::size_t k = 0; k < count; ++k)
+            res[k] = f(k);
+    }
+
+    void compute(std::size_t i, const std::span<const std::span<const T>> columns, std::size_t first, std::size_t count) {
+        const instruction& ins = _program.code()[i];
+        const auto& [a, b, c] = ins.args;
+        if (ins.op == operator_index::variable) {
+            _operands[i] = columns[a].data() + first;
+            return;
+        }
+        T* res = _workspace.data() + i * block_size;
+        _operands[i] = res;
+        if (ins.op == operator_index::constant) {
+            std::fill_n(res, count, static_cast<T>(_program.constants()[a]));
+            return;
+        }
+        // unused operands refer to the first one, every pointer is dereferenced by apply
+        const std::size_t operands = arity(ins.op);
+        const T* x = _operands[a];
+        const T* y = operands > 1 ? _operands[b] : x;
+        const T* z = operands > 2 ? _operands[c] : x;
+        switch (ins.op) {
+        case operator_index::plus:
+            transform(res, count, [x, y](std::size_t k) { return x[k] + y[k]; });
+            break;
+        case operator_index::minus:
+            transform(res, count, [x, y](std::size_t k) { return x[k] - y[k]; });
+            break;
+        case operator_index::multiply:
+            transform(res, count, [x, y](std::size_t k) { return x[k] * y[k]; });
+            break;
+        case operator_index::divide:
+            transform(res, count, [x, y](std::size_t k) { return x[k] / y[k]; });
+            break;
+        case operator_index::unary_minus:
+            transform(res, count, [x](std::size_t k) { return -x[k]; });
+            break;
+        case operator_index::sqr:
+            transform(res, count, [x](std::size_t k) { return x[k] * x[k]; });
+            break;
+        case operator_index::fma:
+            transform(res, count, [x, y, z](std::size_t k) { using std::fma; return T(fma(x[k], y[k], z[k])); });
+            break;
+        case operator_index::powi:
+            transform(res, count, [x, b](std::size_t k) { return utils::powi(x[k], static_cast<std::int32_t>(b)); });
+            break;
+        case operator_index::polynomial: {
+            const double* coefficients = _program.constants().data() + b;
+            transform(res, count, [x, coefficients, c](std::size_t k) { return utils::horner(coefficients, c, x[k]); });
+            break;
+        }
+        default: {
+            const operator_index op = ins.op;
+            transform(res, count, [op, x, y, z](std::size_t k) { return apply<T>(op, x[k], y[k], z[k]); });
+            break;
+        }
+        }
+    }
+
+    const program& _program;
+    std::vector<T> _workspace;
+    std::vector<const T*> _operands;
+    std::vector<std::size_t> _levels;
+};
+
+// Rows of one chunk, it is the unit of work of one thread.
+inline constexpr std::size_t batch_chunk_size = 16 * 256;
+
+inline std::size_t batch_threads(std::size_t threads, std::size_t chunks) {
+    if (threads == 0)
+        threads = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+    return std::max<std::size_t>(std::min(threads, chunks), 1);
+}
+
+// Calls f(first, count) for consecutive ranges of at most chunk_size items, threads take ranges in any order.
+template<class F>
+void for_each_range(std::size_t items, std::size_t chunk_size, std::size_t threads, F f) {
+    const std::size_t chunks = (items + chunk_size - 1) / chunk_size;
+    threads = batch_threads(threads, chunks);
+    std::atomic<std::size_t> next_chunk{0};
+    const auto worker = [&]() {
+        for (std::size_t chunk = next_chunk++; chunk < chunks; chunk = next_chunk++)
+            f(chunk * chunk_size, std::min(chunk_size, items - chunk * chunk_size));
+    };
+    if (threads == 1) {
+        worker();
+        return;
+    }
+    std::vector<std::jthread> pool;
+    for (std::size_t t = 0; t + 1 < threads; ++t)
+        pool.emplace_back(worker);
+    worker();
+}
+
+// Calls f(evaluator, chunk, first_row, rows) for every chunk, every thread owns its own evaluator.
+template<typename T, class F>
+void for_each_chunk(const program& compiled, std::size_t rows, std::size_t threads, F f) {
+    const std::size_t chunks = (rows + batch_chunk_size - 1) / batch_chunk_size;
+    threads = batch_threads(threads, chunks);
+    std::atomic<std::size_t> next_chunk{0};
+    const auto worker = [&]() {
+        block_evaluator<T> evaluator(compiled);
+        for (std::size_t chunk = next_chunk++; chunk < chunks; chunk = next_chunk++)
+            f(evaluator, chunk, chunk * batch_chunk_size, std::min(batch_chunk_size, rows - chunk * batch_chunk_size));
+    };
+    if (threads == 1) {
+        worker();
+        return;
+    }
+    std::vector<std::jthread> pool;
+    for (std::size_t t = 0; t + 1 < threads; ++t)
+        pool.emplace_back(worker);
+    worker();
+}
+
+template<typename T>
+void evaluate_batch(const program& compiled, const std::span<const std::span<const T>> columns, const std::span<T> out, std::size_t threads = 1) {
+    for_each_chunk<T>(compiled, out.size(), threads, [&columns, &out](block_evaluator<T>& evaluator, std::size_t, std::size_t first, std::size_t rows) {
+        for (std::size_t row = first; row < first + rows; row += block_evaluator<T>::block_size) {
+            const std::size_t count = std::min(block_evaluator<T>::block_size, first + rows - row);
+            const T* res = evaluator(columns, row, count);
+            std::copy_n(res, count, out.data() + row);
+        }
+    });
+}
+
+// Pairwise summation: rounding error grows as log(n) and the order of additions is fixed.
+template<typename T>
+T pairwise_sum(const T* values, std::size_t count) {
+    static constexpr std::size_t base = 8;
+    if (count <= base) {
+        T res = T(0);
+        for (std::size_t k = 0; k < count; ++k)
+            res += values[k];
+        return res;
+    }
+    const std::size_t half = count / 2;
+    return pairwise_sum(values, half) + pairwise_sum(values + half, count - half);
+}
+
+template<typename T>
+struct batch_statistics {
+    std::size_t count = 0;
+    T sum = T(0);
+    T min = std::numeric_limits<T>::max();
+    T max = std::numeric_limits<T>::lowest();
+
+    T mean() const {
+        return count == 0 ? T(0) : sum / static_cast<T>(count);
+    }
+};
+
+template<typename T>
+batch_statistics<T> reduce_batch(const program& compiled, const std::span<const std::span<const T>> columns, std::size_t rows, std::size_t threads = 1) {
+    const std::size_t chunks = (rows + batch_chunk_size - 1) / batch_chunk_size;
+    std::vector<batch_statistics<T>> partials(chunks);
+    for_each_chunk<T>(compiled, rows, threads, [&columns, &partials](block_evaluator<T>& evaluator, std::size_t chunk, std::size_t first, std::size_t count) {
+        static constexpr std::size_t blocks = batch_chunk_size / block_evaluator<T>::block_size;
+        std::array<T, blocks> sums{};
+        batch_statistics<T>& partial = partials[chunk];
+        std::size_t block = 0;
+        for (std::size_t row = first; row < first + count; row += block_evaluator<T>::block_size, ++block) {
+            const std::size_t block_rows = std::min(block_evaluator<T>::block_size, first + count - row);
+            const T* res = evaluator(columns, row, block_rows);
+            sums[block] = pairwise_sum(res, block_rows);
+            for (std::size_t k = 0; k < block_rows; ++k) {
+                partial.min = res[k] < partial.min ? res[k] : partial.min;
+                partial.max = partial.max < res[k] ? res[k] : partial.max;
+            }
+        }
+        partial.count = count;
+        partial.sum = pairwise_sum(sums.data(), block);
+    });
+    batch_statistics<T> res;
+    std::vector<T> sums(chunks);
+    for (std::size_t chunk = 0; chunk < chunks; ++chunk) {
+        res.count += partials[chunk].count;
+        res.min = partials[chunk].min < res.min ? partials[chunk].min : res.min;
+        res.max = res.max < partials[chunk].max ? partials[chunk].max : res.max;
+        sums[chunk] = partials[chunk].sum;
+    }
+    res.sum = pairwise_sum(sums.data(), chunks);
+    return res;
+}
+
+// Equal bins on [lower, upper), values outside of the range and NaN are counted separately.
+struct histogram {
+    std::vector<std::size_t> bins{};
+    std::size_t underflow = 0;
+    std::size_t overflow = 0;
+    std::size_t nan = 0;
+};
+
+template<typename T>
+histogram histogram_batch(const program& compiled, const std::span<const std::span<const T>> columns, std::size_t rows,
+                          T lower, T upper, std::size_t bins, std::size_t threads = 1) {
+    if (!(lower < upper) || bins == 0)
+        throw std::domain_error{"Wrong histogram range. Lower bound must be less than upper one and at least one bin is required."};
+    const std::size_t chunks = (rows + batch_chunk_size - 1) / batch_chunk_size;
+    std::vector<histogram> partials(chunks, histogram{std::vector<std::size_t>(bins, 0)});
+    const double scale = double(bins) / (double(upper) - double(lower));
+    for_each_chunk<T>(compiled, rows, threads, [&](block_evaluator<T>& evaluator, std::size_t chunk, std::size_t first, std::size_t count) {
+        histogram& partial = partials[chunk];
+        for (std::size_t row = first; row < first + count; row += block_evaluator<T>::block_size) {
+            const std::size_t block_rows = std::min(block_evaluator<T>::block_size, first + count - row);
+            const T* res = evaluator(columns, row, block_rows);
+            for (std::size_t k = 0; k < block_rows; ++k) {
+                if (res[k] != res[k])
+                    ++partial.nan;
+                else if (res[k] < lower)
+                    ++partial.underflow;
+                else if (!(res[k] < upper))
+                    ++partial.overflow;
+                else
+                    ++partial.bins[std::min(bins - 1, static_cast<std::size_t>((double(res[k]) - double(lower)) * scale))];
+            }
+        }
+    });
+    histogram res{std::vector<std::size_t>(bins, 0)};
+    for (const histogram& partial : partials) {
+        for (std::size_t bin = 0; bin < bins; ++bin)
+            res.bins[bin] += partial.bins[bin];
+        res.underflow += partial.underflow;
+        res.overflow += partial.overflow;
+        res.nan += partial.nan;
+    }
+    return res;
+}
+
+}
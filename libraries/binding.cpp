@@ -0,0 +1,17 @@
+#include "binding.hpp"
+
+namespace parser {
+
+std::optional<MathParser> try_compile(std::string pre_infix_notation, status& st) {
+    try {
+        MathParser formula(std::move(pre_infix_notation));
+        for (const std::string& warning : formula.warnings())
+            st.warning(warning);
+        return formula;
+    } catch (const std::exception& e) {
+        st.error(e.what());
+        return std::nullopt;
+    }
+}
+
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "diagnostics.hpp"
+#include "parser.hpp"
+
+#include <limits>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Bind once, evaluate many. Input layout of the caller is validated when the formula is bound, variable
+// instructions are redirected to the caller fields, so evaluation does no checks, allocations or I/O and
+// never throws. Problems are reported through status instead of exceptions.
+namespace parser {
+
+// Compiles formula, the error is added to st instead of being thrown.
+std::optional<MathParser> try_compile(std::string pre_infix_notation, status& st);
+
+template<utils::arithmetic T>
+class bound_formula {
+public:
+    // Invalid handle, evaluation gives NaN (0 for integers).
+    bound_formula() = default;
+
+    // fields[k] is the name of the k-th value of caller records. Every variable of the formula must be
+    // present among fields, fields which the formula does not use are ignored. Errors reported to st by earlier
+    // operations do not affect the result.
+    static bound_formula bind(const MathParser& formula, const std::span<const std::string_view> fields, status& st) {
+        const std::size_t first = st.diagnostics.size();
+        const auto variables = formula.get_variables();
+        std::vector<std::uint32_t> slots(variables.size(), 0);
+        std::vector<bool> found(variables.size(), false);
+        for (std::size_t k = 0; k < fields.size(); ++k) {
+            const auto it = variables.find(std::string(fields[k]));
+            if (it == variables.end())
+                continue;
+            if (found[it->second]) {
+                st.error("Field <" + std::string(fields[k]) + "> is bound twice.");
+                continue;
+            }
+            found[it->second] = true;
+            slots[it->second] = static_cast<std::uint32_t>(k);
+        }
+        for (const auto& [name, slot] : variables)
+            if (!found[slot])
+                st.error("Variable <" + name + "> is not bound to any field.");
+        for (const std::string& warning : formula.warnings())
+            st.warning(warning);
+        if (!st.ok_since(first))
+            return {};
+
+        bound_formula res;
+        const program& compiled = formula.get_program();
+        res._code = compiled.code();
+        for (instruction& ins : res._code)
+            if (ins.op == operator_index::variable)
+                ins.args[0] = slots[ins.args[0]];
+        res._constants = compiled.constants();
+        res._values.resize(res._code.size());
+        res._fields_count = fields.size();
+        return res;
+    }
+
+    bool valid() const noexcept {
+        return !_code.empty();
+    }
+    std::size_t fields_count() const noexcept {
+        return _fields_count;
+    }
+
+    // record holds fields_count() values in the order of bound fields. The handle keeps its own workspace,
+    // every thread needs its own copy.
+    T operator()(const T* record) noexcept {
+        if (_code.empty()) [[unlikely]]
+            return std::numeric_limits<T>::quiet_NaN();
+        const std::span<const T> input(record, _fields_count);
+        T* values = _values.data();
+        for (std::size_t i = 0; i < _code.size(); ++i)
+            values[i] = execute(_code[i], values, _constants.data(), input);
+        return values[_code.size() - 1];
+    }
+
+    // Row-wise evaluation, record k starts at records + k * stride.
+    void operator()(const T* records, std::size_t stride, const std::span<T> out) noexcept {
+        for (std::size_t k = 0; k < out.size(); ++k)
+            out[k] = (*this)(records + k * stride);
+    }
+
+private:
+    std::vector<instruction> _code{};
+    std::vector<double> _constants{};
+    std::vector<T> _values{};
+    std::size_t _fields_count = 0;
+};
+
+// Binds members of caller struct by name: {"x", &point::x}.
+template<class Record, utils::arithmetic T>
+using field = std::pair<std::string_view, T Record::*>;
+
+template<class Record, utils::arithmetic T>
+class bound_struct {
+public:
+    bound_struct() = default;
+
+    static bound_struct bind(const MathParser& formula, const std::span<const field<Record, T>> fields, status& st) {
+        std::vector<std::string_view> names;
+        for (const auto& f : fields)
+            names.push_back(f.first);
+        bound_struct res;
+        res._formula = bound_formula<T>::bind(formula, names, st);
+        if (!res._formula.valid())
+            return res;
+        for (const auto& f : fields)
+            res._members.push_back(f.second);
+        res._record.resize(fields.size());
+        return res;
+    }
+
+    bool valid() const noexcept {
+        return _formula.valid();
+    }
+
+    T operator()(const Record& record) noexcept {
+        for (std::size_t k = 0; k < _members.size(); ++k)
+            _record[k] = record.*_members[k];
+        return _formula(_record.data());
+    }
+
+    void operator()(const std::span<const Record> records, const std::span<T> out) noexcept {
+        for (std::size_t k = 0; k < out.size(); ++k)
+            out[k] = (*this)(records[k]);
+    }
+
+private:
+    bound_formula<T> _formula{};
+    std::vector<T Record::*> _members{};
+    std::vector<T> _record{};
+};
+
+}
@@ -0,0 +1,187 @@
+#include "bulk.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PARSER_HAS_MMAP 1
+#else
+#define PARSER_HAS_MMAP 0
+#endif
+
+namespace {
+
+// Read only view of the whole file.
+class mapped_file {
+public:
+    explicit mapped_file(const std::string& path) {
+#if PARSER_HAS_MMAP
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::domain_error{"Can not open file <" + path + ">."};
+        struct stat info {};
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::domain_error{"Can not read file <" + path + ">."};
+        }
+        _size = static_cast<std::size_t>(info.st_size);
+        if (_size > 0) {
+            void* data = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (data == MAP_FAILED)
+                throw std::domain_error{"Can not map file <" + path + ">."};
+            _data = static_cast<const char*>(data);
+        } else {
+            ::close(fd);
+        }
+#else
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            throw std::domain_error{"Can not open file <" + path + ">."};
+        std::ostringstream content;
+        content << file.rdbuf();
+        _buffer = content.str();
+        _data = _buffer.data();
+        _size = _buffer.size();
+#endif
+    }
+    ~mapped_file() {
+#if PARSER_HAS_MMAP
+        if (_data != nullptr)
+            ::munmap(const_cast<char*>(_data), _size);
+#endif
+    }
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    std::string_view view() const {
+        return {_data, _size};
+    }
+
+private:
+    const char* _data = nullptr;
+    std::size_t _size = 0;
+#if !PARSER_HAS_MMAP
+    std::string _buffer;
+#endif
+};
+
+std::vector<std::string_view> split_lines(std::string_view text) {
+    std::vector<std::string_view> lines;
+    while (!text.empty()) {
+        const std::size_t end = text.find('\n');
+        std::string_view line = text.substr(0, end);
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        lines.push_back(line);
+        if (end == std::string_view::npos)
+            break;
+        text.remove_prefix(end + 1);
+    }
+    return lines;
+}
+
+struct line_result {
+    std::optional<parser::compiled_formula> formula;
+    std::vector<parser::diagnostic> diagnostics;
+};
+
+}
+
+namespace parser {
+
+double bulk_result::formulas_per_second() const {
+    return seconds > 0 ? double(formulas.size()) / seconds : 0.;
+}
+
+bool parse_formula_line(std::string_view line, std::string& name, std::string& formula) {
+    const std::string trimmed = utils::trim(std::string(line));
+    if (trimmed.empty() || trimmed.front() == '#')
+        return false;
+    const std::size_t open = trimmed.find('|');
+    const std::size_t close = trimmed.rfind('|');
+    if (open == std::string::npos) {
+        name.clear();
+        formula = trimmed;
+        return true;
+    }
+    if (close == open)
+        throw std::domain_error{"Wrong formula format. Closing '|' is required."};
+    if (!utils::trim(trimmed.substr(close + 1)).empty())
+        throw std::domain_error{"Wrong formula format. Unexpected symbols after closing '|'."};
+    name = utils::trim(trimmed.substr(0, open));
+    if (!name.empty()) {
+        if (name.back() != '=')
+            throw std::domain_error{"Wrong formula format. Name must be followed by '='."};
+        name = utils::trim(name.substr(0, name.size() - 1));
+    }
+    formula = trimmed.substr(open + 1, close - open - 1);
+    return true;
+}
+
+bulk_result compile_text(std::string_view text, std::size_t threads) {
+    const auto start = std::chrono::steady_clock::now();
+    const std::vector<std::string_view> lines = split_lines(text);
+    std::vector<line_result> results(lines.size());
+
+    static constexpr std::size_t lines_per_task = 64;
+    const std::size_t tasks = (lines.size() + lines_per_task - 1) / lines_per_task;
+    if (threads == 0)
+        threads = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+    threads = std::max<std::size_t>(std::min(threads, tasks), 1);
+
+    std::atomic<std::size_t> next_task{0};
+    const auto worker = [&]() {
+        std::string name, formula;
+        for (std::size_t task = next_task++; task < tasks; task = next_task++) {
+            for (std::size_t i = task * lines_per_task; i < std::min(lines.size(), (task + 1) * lines_per_task); ++i) {
+                line_result& res = results[i];
+                try {
+                    if (!parse_formula_line(lines[i], name, formula))
+                        continue;
+                    MathParser parser(formula);
+                    for (const std::string& warning : parser.warnings())
+                        res.diagnostics.push_back({diagnostic::severity::warning, i + 1, warning});
+                    res.formula.emplace(compiled_formula{i + 1, name, formula, std::move(parser)});
+                } catch (const std::exception& e) {
+                    res.diagnostics.push_back({diagnostic::severity::error, i + 1, e.what()});
+                }
+            }
+        }
+    };
+    {
+        std::vector<std::jthread> pool;
+        for (std::size_t t = 0; t + 1 < threads; ++t)
+            pool.emplace_back(worker);
+        worker();
+    }
+
+    bulk_result res;
+    for (line_result& line : results) {
+        if (line.formula)
+            res.formulas.push_back(std::move(*line.formula));
+        for (diagnostic& d : line.diagnostics) {
+            res.errors += d.level == diagnostic::severity::error;
+            res.diagnostics.push_back(std::move(d));
+        }
+    }
+    res.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return res;
+}
+
+bulk_result compile_file(const std::string& path, std::size_t threads) {
+    const mapped_file file(path);
+    return compile_text(file.view(), threads);
+}
+
+}
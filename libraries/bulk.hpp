@@ -0,0 +1,41 @@
+#pragma once
+
+#include "diagnostics.hpp"
+#include "parser.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Compilation of formula libraries: one formula per line in the form [name =] |variables : expression|.
+// Empty lines and lines starting with '#' are skipped. Lines are compiled by several threads, a wrong line is
+// reported and does not stop the others.
+namespace parser {
+
+struct compiled_formula {
+    std::size_t line;
+    std::string name;
+    // formula text without bars
+    std::string source;
+    MathParser formula;
+};
+
+struct bulk_result {
+    // compiled formulas in the order of lines
+    std::vector<compiled_formula> formulas{};
+    std::vector<diagnostic> diagnostics{};
+    std::size_t errors = 0;
+    double seconds = 0;
+
+    double formulas_per_second() const;
+};
+
+// Splits line into name and formula without bars. Returns false for empty and comment lines.
+bool parse_formula_line(std::string_view line, std::string& name, std::string& formula);
+
+// threads = 0 uses all hardware threads.
+bulk_result compile_text(std::string_view text, std::size_t threads = 0);
+// The file is memory mapped where it is supported.
+bulk_result compile_file(const std::string& path, std::size_t threads = 0);
+
+}
@@ -0,0 +1,261 @@
+#include "codegen.hpp"
+
+#include <cmath>
+#include <ios>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+using parser::operator_index;
+
+// Exact literal of double.
+std::string literal(double value) {
+    if (std::isnan(value))
+        return "std::numeric_limits<double>::quiet_NaN()";
+    if (std::isinf(value))
+        return value > 0 ? "std::numeric_limits<double>::infinity()" : "-std::numeric_limits<double>::infinity()";
+    std::ostringstream out;
+    out << std::hexfloat << value;
+    return out.str();
+}
+
+// Appends instead of "t" + std::to_string(index): GCC 12 reports a false -Wrestrict for the concatenation.
+std::string numbered(const char* prefix, std::uint32_t index) {
+    std::string res = prefix;
+    res += std::to_string(index);
+    return res;
+}
+
+std::string temporary(std::uint32_t index) {
+    return numbered("t", index);
+}
+
+const char* function_name(operator_index op) {
+    switch (op) {
+    case operator_index::power: return "pow";
+    case operator_index::sqrt: return "sqrt";
+    case operator_index::cbrt: return "cbrt";
+    case operator_index::sin: return "sin";
+    case operator_index::asin: return "asin";
+    case operator_index::sinh: return "sinh";
+    case operator_index::asinh: return "asinh";
+    case operator_index::cos: return "cos";
+    case operator_index::acos: return "acos";
+    case operator_index::cosh: return "cosh";
+    case operator_index::acosh: return "acosh";
+    case operator_index::tan: return "tan";
+    case operator_index::atan: return "atan";
+    case operator_index::tanh: return "tanh";
+    case operator_index::atanh: return "atanh";
+    case operator_index::exp: return "exp";
+    case operator_index::exp2: return "exp2";
+    case operator_index::expm1: return "expm1";
+    case operator_index::log: return "log";
+    case operator_index::log10: return "log10";
+    case operator_index::log2: return "log2";
+    case operator_index::log1p: return "log1p";
+    case operator_index::abs: return "abs";
+    case operator_index::ceil: return "ceil";
+    case operator_index::floor: return "floor";
+    case operator_index::trunc: return "trunc";
+    case operator_index::round: return "round";
+    case operator_index::tgamma: return "tgamma";
+    case operator_index::lgamma: return "lgamma";
+    case operator_index::erf: return "erf";
+    case operator_index::erfc: return "erfc";
+    case operator_index::fma: return "fma";
+    case operator_index::hypot: return "hypot";
+    case operator_index::atan2: return "atan2";
+    default: return nullptr;
+    }
+}
+
+const char* infix_name(operator_index op) {
+    switch (op) {
+    case operator_index::plus: return " + ";
+    case operator_index::minus: return " - ";
+    case operator_index::multiply: return " * ";
+    case operator_index::divide: return " / ";
+    case operator_index::less: return " < ";
+    case operator_index::less_equal: return " <= ";
+    case operator_index::greater: return " > ";
+    case operator_index::greater_equal: return " >= ";
+    case operator_index::equal: return " == ";
+    case operator_index::not_equal: return " != ";
+    default: return nullptr;
+    }
+}
+
+// Right side of the statement which computes instruction, it repeats apply and execute from program.hpp.
+std::string expression(const parser::instruction& ins, const std::vector<double>& constants) {
+    const auto& [a, b, c] = ins.args;
+    const std::string x = temporary(a), y = temporary(b), z = temporary(c);
+    const std::string select = "parser::ex::pack_traits<T>::select";
+    switch (ins.op) {
+    case operator_index::constant:
+        return "T(" + literal(constants[a]) + ")";
+    case operator_index::variable:
+        return numbered("v", a);
+    case operator_index::unary_minus:
+        return "-" + x;
+    // branches go through the same hooks as apply, pack_traits::select chooses by masks of packs
+    case operator_index::sqr:
+        return "sqr(" + x + ")";
+    case operator_index::sign:
+        return select + "(" + x + " > T(0), T(1), " + select + "(" + x + " < T(0), T(-1), T(0)))";
+    case operator_index::min:
+        return "min(" + x + ", " + y + ")";
+    case operator_index::max:
+        return "max(" + x + ", " + y + ")";
+    case operator_index::select:
+        return select + "(" + x + " != T(0), " + y + ", " + z + ")";
+    case operator_index::clamp:
+        return "min(max(" + x + ", " + y + "), " + z + ")";
+    case operator_index::powi:
+        return "powi(" + x + ", " + std::to_string(static_cast<std::int32_t>(b)) + ")";
+    case operator_index::polynomial: {
+        // Horner scheme as utils::horner
+        std::string res = "T(" + literal(constants[b + c - 1]) + ")";
+        for (std::size_t k = c - 1; k > 0; --k)
+            res = "fma(" + res + ", " + x + ", T(" + literal(constants[b + k - 1]) + "))";
+        return res;
+    }
+    default:
+        break;
+    }
+    if (const char* infix = infix_name(ins.op)) {
+        const std::string res = x + infix + y;
+        return ins.op >= operator_index::less && ins.op <= operator_index::not_equal ? select + "(" + res + ", T(1), T(0))" : res;
+    }
+    const char* function = function_name(ins.op);
+    if (function == nullptr)
+        throw std::domain_error{"Code generation is not supported for the operator."};
+    std::string res = std::string(function) + "(" + x;
+    if (parser::arity(ins.op) > 1)
+        res += ", " + y;
+    if (parser::arity(ins.op) > 2)
+        res += ", " + z;
+    return res + ")";
+}
+
+bool is_identifier(const std::string& name) {
+    static const std::set<std::string> reserved{ "formulas", "find", "auto", "bool", "break", "case", "char", "class", "const",
+                                                 "default", "delete", "do", "double", "else", "enum", "float", "for",
+                                                 "if", "int", "long", "namespace", "new", "operator", "return", "short",
+                                                 "static", "struct", "switch", "template", "this", "typename", "using",
+                                                 "void", "while" };
+    if (name.empty() || std::isdigit(static_cast<unsigned char>(name.front())) || reserved.contains(name))
+        return false;
+    for (const char symbol : name)
+        if (!std::isalnum(static_cast<unsigned char>(symbol)) && symbol != '_')
+            return false;
+    return true;
+}
+
+std::string escape(const std::string& text) {
+    std::string res;
+    for (const char symbol : text) {
+        if (symbol == '"' || symbol == '\\')
+            res += '\\';
+        res += symbol;
+    }
+    return res;
+}
+
+}
+
+namespace parser {
+
+std::string generate_function(const std::string& name, const MathParser& formula) {
+    const program& compiled = formula.get_program();
+    std::ostringstream out;
+    out << "template<typename T>\n";
+    out << "inline T " << name << "(";
+    for (std::size_t k = 0; k < compiled.variables_count(); ++k)
+        out << (k == 0 ? "" : ", ") << "const T& v" << k;
+    out << ") {\n";
+    out << "    using std::sin; using std::asin; using std::sinh; using std::asinh; using std::cos; using std::acos;\n"
+           "    using std::cosh; using std::acosh; using std::tan; using std::atan; using std::tanh; using std::atanh;\n"
+           "    using std::exp; using std::exp2; using std::expm1; using std::log; using std::log10; using std::log2;\n"
+           "    using std::log1p; using std::abs; using std::ceil; using std::floor; using std::trunc; using std::round;\n"
+           "    using std::tgamma; using std::lgamma; using std::erf; using std::erfc; using std::sqrt; using std::cbrt;\n"
+           "    using std::pow; using std::fma; using std::hypot; using std::atan2; using std::min; using std::max;\n"
+           "    using parser::utils::sqr; using parser::utils::powi;\n";
+    const auto& code = compiled.code();
+    for (std::uint32_t i = 0; i < code.size(); ++i)
+        out << "    const T " << temporary(i) << " = " << expression(code[i], compiled.constants()) << ";\n";
+    out << "    return " << temporary(static_cast<std::uint32_t>(code.size() - 1)) << ";\n";
+    out << "}\n";
+    return out.str();
+}
+
+std::string generate_header(const std::span<const compiled_formula> formulas, const std::string& name_space, status& st) {
+    if (!is_identifier(name_space))
+        throw std::domain_error{"Namespace <" + name_space + "> is not a C++ identifier."};
+    std::ostringstream out;
+    out << "// Generated by FormulaCodegen, do not edit.\n";
+    out << "#pragma once\n\n";
+    out << "#include \"generated.hpp\"\n\n";
+    out << "#include <array>\n#include <cmath>\n#include <limits>\n#include <span>\n\n";
+    out << "namespace " << name_space << " {\n";
+
+    std::set<std::string> names;
+    std::vector<const compiled_formula*> accepted;
+    for (const compiled_formula& formula : formulas) {
+        if (!is_identifier(formula.name)) {
+            st.error("Formula name <" + formula.name + "> is not a C++ identifier.", formula.line);
+            continue;
+        }
+        if (!names.insert(formula.name).second) {
+            st.error("Formula <" + formula.name + "> is defined twice.", formula.line);
+            continue;
+        }
+        const std::size_t variables = formula.formula.variables_count();
+        std::vector<std::string> ordered(variables);
+        for (const auto& [variable, slot] : formula.formula.get_variables())
+            ordered[slot] = variable;
+        out << "\n// " << formula.name << " = |" << formula.source << "|\n";
+        out << "// v0, v1, ... are";
+        for (const std::string& variable : ordered)
+            out << " " << variable;
+        out << "\n";
+        out << generate_function(formula.name, formula.formula) << "\n";
+
+        out << "template<typename T>\n";
+        // formulas without variables do not read their input
+        const char* unused = variables == 0 ? "[[maybe_unused]] " : "";
+        out << "inline T " << formula.name << "(" << unused << "std::span<const T> input) {\n";
+        out << "    return " << formula.name << "<T>(";
+        for (std::size_t k = 0; k < variables; ++k)
+            out << (k == 0 ? "" : ", ") << "input[" << k << "]";
+        out << ");\n}\n\n";
+
+        out << "template<typename T>\n";
+        out << "inline void " << formula.name << "_batch(" << unused << "std::span<const std::span<const T>> columns, std::span<T> out) {\n";
+        for (std::size_t k = 0; k < variables; ++k)
+            out << "    const T* c" << k << " = columns[" << k << "].data();\n";
+        out << "    for (std::size_t i = 0; i < out.size(); ++i)\n";
+        out << "        out[i] = " << formula.name << "<T>(";
+        for (std::size_t k = 0; k < variables; ++k)
+            out << (k == 0 ? "" : ", ") << "c" << k << "[i]";
+        out << ");\n}\n";
+        accepted.push_back(&formula);
+    }
+
+    out << "\ninline constexpr std::array<parser::generated_formula, " << accepted.size() << "> formulas{{\n";
+    for (const compiled_formula* formula : accepted) {
+        out << "    { \"" << formula->name << "\", \"" << escape(formula->source) << "\", "
+            << formula->formula.variables_count() << ",\n"
+            << "      static_cast<double (*)(std::span<const double>)>(&" << formula->name << "<double>),\n"
+            << "      &" << formula->name << "_batch<double> },\n";
+    }
+    out << "}};\n\n";
+    out << "inline const parser::generated_formula* find(std::string_view name) {\n";
+    out << "    return parser::find_generated(formulas, name);\n}\n\n";
+    out << "}\n";
+    return out.str();
+}
+
+}
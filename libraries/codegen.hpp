@@ -0,0 +1,21 @@
+#pragma once
+
+#include "bulk.hpp"
+#include "diagnostics.hpp"
+
+#include <span>
+#include <string>
+
+// Generation of C++ code from compiled formulas. Every instruction of the optimized program becomes one statement,
+// so generated functions compute exactly what the interpreter computes.
+namespace parser {
+
+// Body of template<typename T> function which takes variables v0, v1, ... in the order of their slots.
+std::string generate_function(const std::string& name, const MathParser& formula);
+
+// Header with inline function templates name(v0, ...), name(span), name_batch(columns, out) for every formula
+// and the table of them name_space::formulas. Formulas must have distinct names which are C++ identifiers,
+// other formulas are reported to st and skipped.
+std::string generate_header(std::span<const compiled_formula> formulas, const std::string& name_space, status& st);
+
+}
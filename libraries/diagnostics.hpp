@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace parser {
+
+// Problem found in a formula which is reported instead of thrown.
+struct diagnostic {
+    enum class severity { warning, error };
+
+    severity level;
+    // line of the source starting with 1, 0 if the formula is not a part of a file
+    std::size_t line;
+    std::string message;
+};
+
+// Result of an operation which reports problems instead of throwing.
+struct status {
+    std::vector<diagnostic> diagnostics{};
+
+    bool ok() const noexcept {
+        return ok_since(0);
+    }
+    // No errors among diagnostics from index first on, status shared by several operations is checked for the last one.
+    bool ok_since(std::size_t first) const noexcept {
+        for (std::size_t k = first; k < diagnostics.size(); ++k)
+            if (diagnostics[k].level == diagnostic::severity::error)
+                return false;
+        return true;
+    }
+    explicit operator bool() const noexcept {
+        return ok();
+    }
+    void error(std::string message, std::size_t line = 0) {
+        diagnostics.push_back({diagnostic::severity::error, line, std::move(message)});
+    }
+    void warning(std::string message, std::size_t line = 0) {
+        diagnostics.push_back({diagnostic::severity::warning, line, std::move(message)});
+    }
+};
+
+}
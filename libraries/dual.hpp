@@ -0,0 +1,116 @@
+#pragma once
+
+#include "utils.hpp"
+
+#include <cmath>
+#include <numbers>
+
+// Forward mode differentiation: dual number carries the value and the derivative along one direction.
+// Evaluation of a program with dual inputs gives the directional derivative together with the value.
+// Comparisons and selections use values only, step functions (sign, floor, comparisons) have zero derivative.
+// Terms of inputs with zero derivative are skipped, so an infinite slope at the edge of the domain of one variable
+// (sqrt(0), log(0)) does not turn derivatives along other variables into NaN.
+namespace parser {
+
+template<typename T>
+struct dual {
+    T value = T(0);
+    T derivative = T(0);
+
+    constexpr dual() = default;
+    constexpr dual(T value, T derivative = T(0)) : value(value), derivative(derivative) {}
+
+    dual& operator+=(const dual& b) {
+        value += b.value;
+        derivative += b.derivative;
+        return *this;
+    }
+    dual& operator-=(const dual& b) {
+        value -= b.value;
+        derivative -= b.derivative;
+        return *this;
+    }
+    dual& operator*=(const dual& b) {
+        derivative = scaled(b.value, derivative) + scaled(value, b.derivative);
+        value *= b.value;
+        return *this;
+    }
+    dual& operator/=(const dual& b) {
+        value /= b.value;
+        derivative = (derivative - scaled(value, b.derivative)) / b.value;
+        return *this;
+    }
+
+    // hidden friends, so that constants and integers convert to dual and std functions are not considered
+    friend dual operator+(dual a, const dual& b) { return a += b; }
+    friend dual operator-(dual a, const dual& b) { return a -= b; }
+    friend dual operator*(dual a, const dual& b) { return a *= b; }
+    friend dual operator/(dual a, const dual& b) { return a /= b; }
+    friend dual operator-(const dual& a) { return {-a.value, -a.derivative}; }
+
+    friend bool operator==(const dual& a, const dual& b) { return a.value == b.value; }
+    friend bool operator!=(const dual& a, const dual& b) { return a.value != b.value; }
+    friend bool operator<(const dual& a, const dual& b) { return a.value < b.value; }
+    friend bool operator<=(const dual& a, const dual& b) { return a.value <= b.value; }
+    friend bool operator>(const dual& a, const dual& b) { return a.value > b.value; }
+    friend bool operator>=(const dual& a, const dual& b) { return a.value >= b.value; }
+
+    // slope * derivative, zero for zero derivative even if the slope is infinite or NaN
+    static T scaled(T slope, T derivative) {
+        return derivative == T(0) ? T(0) : slope * derivative;
+    }
+    // f(a) with f'(a) = slope
+    static dual chain(const dual& a, T f, T slope) {
+        return {f, scaled(slope, a.derivative)};
+    }
+
+    friend dual sqrt(const dual& a) { const T r = std::sqrt(a.value); return chain(a, r, T(0.5) / r); }
+    friend dual cbrt(const dual& a) { const T r = std::cbrt(a.value); return chain(a, r, T(1) / (3 * r * r)); }
+    friend dual sin(const dual& a) { return chain(a, std::sin(a.value), std::cos(a.value)); }
+    friend dual cos(const dual& a) { return chain(a, std::cos(a.value), -std::sin(a.value)); }
+    friend dual tan(const dual& a) { const T r = std::tan(a.value); return chain(a, r, 1 + r * r); }
+    friend dual asin(const dual& a) { return chain(a, std::asin(a.value), T(1) / std::sqrt(1 - a.value * a.value)); }
+    friend dual acos(const dual& a) { return chain(a, std::acos(a.value), T(-1) / std::sqrt(1 - a.value * a.value)); }
+    friend dual atan(const dual& a) { return chain(a, std::atan(a.value), T(1) / (1 + a.value * a.value)); }
+    friend dual sinh(const dual& a) { return chain(a, std::sinh(a.value), std::cosh(a.value)); }
+    friend dual cosh(const dual& a) { return chain(a, std::cosh(a.value), std::sinh(a.value)); }
+    friend dual tanh(const dual& a) { const T r = std::tanh(a.value); return chain(a, r, 1 - r * r); }
+    friend dual asinh(const dual& a) { return chain(a, std::asinh(a.value), T(1) / std::sqrt(a.value * a.value + 1)); }
+    friend dual acosh(const dual& a) { return chain(a, std::acosh(a.value), T(1) / std::sqrt(a.value * a.value - 1)); }
+    friend dual atanh(const dual& a) { return chain(a, std::atanh(a.value), T(1) / (1 - a.value * a.value)); }
+    friend dual exp(const dual& a) { const T r = std::exp(a.value); return chain(a, r, r); }
+    friend dual exp2(const dual& a) { const T r = std::exp2(a.value); return chain(a, r, r * std::log(T(2))); }
+    friend dual expm1(const dual& a) { return chain(a, std::expm1(a.value), std::exp(a.value)); }
+    friend dual log(const dual& a) { return chain(a, std::log(a.value), T(1) / a.value); }
+    friend dual log10(const dual& a) { return chain(a, std::log10(a.value), T(1) / (a.value * std::log(T(10)))); }
+    friend dual log2(const dual& a) { return chain(a, std::log2(a.value), T(1) / (a.value * std::log(T(2)))); }
+    friend dual log1p(const dual& a) { return chain(a, std::log1p(a.value), T(1) / (1 + a.value)); }
+    friend dual abs(const dual& a) { return a.value < 0 ? -a : a; }
+    friend dual ceil(const dual& a) { return {std::ceil(a.value)}; }
+    friend dual floor(const dual& a) { return {std::floor(a.value)}; }
+    friend dual trunc(const dual& a) { return {std::trunc(a.value)}; }
+    friend dual round(const dual& a) { return {std::round(a.value)}; }
+    friend dual tgamma(const dual& a) { const T r = std::tgamma(a.value); return chain(a, r, r * T(utils::digamma(a.value))); }
+    friend dual lgamma(const dual& a) { return chain(a, std::lgamma(a.value), T(utils::digamma(a.value))); }
+    friend dual erf(const dual& a) { return chain(a, std::erf(a.value), T(2) * std::numbers::inv_sqrtpi_v<T> * std::exp(-a.value * a.value)); }
+    friend dual erfc(const dual& a) { return chain(a, std::erfc(a.value), -T(2) * std::numbers::inv_sqrtpi_v<T> * std::exp(-a.value * a.value)); }
+
+    // constant exponent of negative base does not give NaN from log
+    friend dual pow(const dual& a, const dual& b) {
+        const T r = std::pow(a.value, b.value);
+        return {r, scaled(b.value * std::pow(a.value, b.value - 1), a.derivative) + scaled(r * std::log(a.value), b.derivative)};
+    }
+    friend dual fma(const dual& a, const dual& b, const dual& c) {
+        return {std::fma(a.value, b.value, c.value), scaled(b.value, a.derivative) + scaled(a.value, b.derivative) + c.derivative};
+    }
+    friend dual hypot(const dual& a, const dual& b) {
+        const T r = std::hypot(a.value, b.value);
+        return {r, scaled(a.value / r, a.derivative) + scaled(b.value / r, b.derivative)};
+    }
+    friend dual atan2(const dual& y, const dual& x) {
+        const T r = x.value * x.value + y.value * y.value;
+        return {std::atan2(y.value, x.value), scaled(x.value / r, y.derivative) - scaled(y.value / r, x.derivative)};
+    }
+};
+
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "parser.hpp"
+#include "simd.hpp"
+
+#include <Eigen/Core>
+
+#include <vector>
+
+// Evaluation of formulas over Eigen matrices without copies. Rows of matrix are samples, columns are variables:
+// in get_variables() order for MathParser and variable<j> for expression templates. Column-major storage is used
+// directly as columnar layout, Eigen::Ref creates a temporary only for arguments with other layout.
+namespace parser {
+
+using matrix_cref = Eigen::Ref<const Eigen::MatrixXd>;
+using vector_ref = Eigen::Ref<Eigen::VectorXd>;
+
+inline std::vector<std::span<const double>> columns_of(const matrix_cref& samples) {
+    std::vector<std::span<const double>> columns;
+    columns.reserve(static_cast<std::size_t>(samples.cols()));
+    for (Eigen::Index j = 0; j < samples.cols(); ++j)
+        columns.emplace_back(samples.data() + j * samples.outerStride(), static_cast<std::size_t>(samples.rows()));
+    return columns;
+}
+
+inline void check_output(const matrix_cref& samples, const vector_ref& out) {
+    if (out.size() != samples.rows())
+        throw std::domain_error{"Wrong output size. Output must contain value for every row of samples."};
+}
+
+inline void evaluate(const MathParser& formula, const matrix_cref& samples, vector_ref out, std::size_t threads = 1) {
+    check_output(samples, out);
+    const auto columns = columns_of(samples);
+    formula.evaluate_batch(std::span<const std::span<const double>>(columns), std::span<double>(out.data(), static_cast<std::size_t>(out.size())), threads);
+}
+
+inline batch_statistics<double> reduce(const MathParser& formula, const matrix_cref& samples, std::size_t threads = 1) {
+    const auto columns = columns_of(samples);
+    return formula.reduce_batch(std::span<const std::span<const double>>(columns), static_cast<std::size_t>(samples.rows()), threads);
+}
+
+// Number of variables M is given explicitly: evaluate<3>(x * y + z, samples, out).
+template<std::size_t M, ex::expression_node E>
+void evaluate(const E& e, const matrix_cref& samples, vector_ref out) {
+    check_output(samples, out);
+    if (samples.cols() != static_cast<Eigen::Index>(M))
+        throw std::domain_error{"Wrong number of columns."};
+    const auto columns = columns_of(samples);
+    std::array<std::span<const double>, M> fixed;
+    std::copy(columns.begin(), columns.end(), fixed.begin());
+    ex::evaluate_batch(e, fixed, std::span<double>(out.data(), static_cast<std::size_t>(out.size())));
+}
+
+}
@@ -2,29 +2,47 @@
 #include "utils.hpp"
 
 #include <math.h>
+#include <cmath>
 #include <vector>
 #include <array>
+#include <type_traits>
 
 namespace parser::ex {
 // Grammatics for Domain specific language (DSL)
 // expression := constant | variable | expression +*/- expression | FUNCTION(expression) | (expression) | -expression 
-template<class E>
-struct math_object_base {
-    E& self() {
-        return static_cast<E&> (*this);
+// Element type of expression evaluation. Functions are called unqualified after `using std::f;`, so packed
+// types (see simd.hpp) are dispatched to their own implementations via ADL. Branches are expressed with select.
+template<typename T>
+struct pack_traits {
+    using value_type = T;
+    static constexpr std::size_t width = 1;
+
+    template<typename Mask>
+    static T select(const Mask& mask, const T& a, const T& b) {
+        using utils::select;
+        return select(mask, a, b);
+    }
+    static T load(const value_type* ptr) {
+        return *ptr;
     }
-    const E& self() const {
-        return static_cast<const E&> (*this);
+    static void store(const T& value, value_type* ptr) {
+        *ptr = value;
     }
 };
 
-// This class does not contain functionality. It takes final class template and translates it to the base class.
+// Empty non-template base of every node. Operators and functions take the node type itself, constrained by
+// expression_node, so a node instantiates one class instead of a CRTP chain of bases, and overload resolution
+// needs no derived-to-base conversions. Nodes are aggregates built by their operators and functions, so no
+// constructors are instantiated for every node type. Children are stored with [[no_unique_address]]: variables
+// and integral constants take no space.
+struct expression_base {};
 template<class E>
-struct expression : math_object_base<E> {};
+concept expression_node = std::is_base_of_v<expression_base, E>;
+
 // ----------------- Constants and variables ----------------- 
 // Integral type constants
 template<int N>
-struct int_constant : expression<int_constant<N>> {
+struct int_constant : expression_base {
     static constexpr int value = N;
 
     template<typename T>
@@ -43,7 +61,7 @@ template<int N>
 struct int_constant_value<int_constant<N>> : std::integral_constant<int, N> {};
 // Other types
 template<typename VT>
-struct scalar : expression<scalar<VT>> {
+struct scalar : expression_base {
     using value_type = VT;
 
     scalar(const value_type& value) : value(value) {}
@@ -65,7 +83,7 @@ scalar<T> _(const T& val) {
 }
 // Variable 
 template<std::size_t N>
-struct variable : expression<variable<N>> {
+struct variable : expression_base {
     template<typename T, std::size_t _Size>
     T operator()(const std::array<T, _Size>& vars) const {
         return vars[N];
@@ -91,20 +109,17 @@ struct negate_expression_type {
         >;
 };
 template<class E>
-struct negate_expression : expression<negate_expression<E>> {
-
-    negate_expression(const expression<E>& e) : e(e.self()) {}
-
+struct negate_expression : expression_base {
     template <typename T, std::size_t M>
     T operator()(const std::array<T, M>& x) const {
         return -e(x);
     }
-    const E e;
+    [[no_unique_address]] const E e;
 };
-template<class E>
+template<expression_node E>
 negate_expression<E>
-operator-(const expression<E>& e) {
-    return negate_expression<E>(e);
+operator-(const E& e) {
+    return negate_expression<E>{{}, e};
 }
 template<int N>
 int_constant<-N>
@@ -122,56 +137,48 @@ template<class E1, char op, class E2>
 struct binary_expression;
 
 template<class E1, char op, class E2>
-struct binary_expression : expression<binary_expression<E1, op, E2> >
-{
-    binary_expression(const expression<E1>& e1, const expression<E2>& e2) : e1(e1.self()), e2(e2.self()) {}
-
-    template <typename T, std::size_t M, char _op = op, typename std::enable_if_t<_op == '+', bool> = false>
-    T operator()(const std::array<T, M>& x) const {
-        return e1(x) + e2(x);
-    }
-    template <typename T, std::size_t M, char _op = op, typename std::enable_if_t<_op == '-', bool> = false>
-    T operator()(const std::array<T, M>& x) const {
-        return e1(x) - e2(x);
-    }
-    template <typename T, std::size_t M, char _op = op, typename std::enable_if_t<_op == '*', bool> = false>
-    T operator()(const std::array<T, M>& x) const {
-        return e1(x) * e2(x);
-    }
-    template <typename T, std::size_t M, char _op = op, typename std::enable_if_t<_op == '/', bool> = false>
+struct binary_expression : expression_base {
+    template <typename T, std::size_t M>
     T operator()(const std::array<T, M>& x) const {
-        return e1(x) / e2(x);
+        if constexpr (op == '+')
+            return e1(x) + e2(x);
+        else if constexpr (op == '-')
+            return e1(x) - e2(x);
+        else if constexpr (op == '*')
+            return e1(x) * e2(x);
+        else
+            return e1(x) / e2(x);
     }
-    const E1 e1;
-    const E2 e2;
+    [[no_unique_address]] const E1 e1;
+    [[no_unique_address]] const E2 e2;
 };
-template<class E1, class E2>
+template<expression_node E1, expression_node E2>
 binary_expression<E1, '+', E2>
-operator +(const expression<E1>& e1, const expression<E2>& e2) {
-    return binary_expression<E1, '+', E2>(e1, e2);
+operator +(const E1& e1, const E2& e2) {
+    return binary_expression<E1, '+', E2>{{}, e1, e2};
 }
-template<class E1, class E2>
+template<expression_node E1, expression_node E2>
 binary_expression<E1, '-', E2>
-operator -(const expression<E1>& e1, const expression<E2>& e2) {
-    return binary_expression<E1, '-', E2>(e1, e2);
+operator -(const E1& e1, const E2& e2) {
+    return binary_expression<E1, '-', E2>{{}, e1, e2};
 }
-template<class E1, class E2>
+template<expression_node E1, expression_node E2>
 binary_expression<E1, '*', E2>
-operator *(const expression<E1>& e1, const expression<E2>& e2) {
-    return binary_expression<E1, '*', E2>(e1, e2);
+operator *(const E1& e1, const E2& e2) {
+    return binary_expression<E1, '*', E2>{{}, e1, e2};
 }
-template<class E1, class E2>
+template<expression_node E1, expression_node E2>
 binary_expression<E1, '/', E2>
-operator /(const expression<E1>& e1, const expression<E2>& e2) {
-    return binary_expression<E1, '/', E2>(e1, e2);
+operator /(const E1& e1, const E2& e2) {
+    return binary_expression<E1, '/', E2>{{}, e1, e2};
 }
 
-template<class E>
-const E& operator+(const expression<E>& e, const int_constant<0>&) {
-    return e.self();
+template<expression_node E> requires (!is_int_constant<E>::value)
+const E& operator+(const E& e, const int_constant<0>&) {
+    return e;
 }
-template<class E>
-int_constant<0> operator*(const expression<E>& e, const int_constant<0>&) {
+template<expression_node E> requires (!is_int_constant<E>::value)
+int_constant<0> operator*(const E& e, const int_constant<0>&) {
     return int_constant<0>();
 }
 template<int N1, int N2>
@@ -193,160 +200,222 @@ operator*(const int_constant<N1>&, const int_constant<N2>&) {
 // --------------------------Functions------------------------
 // Trigonometry (sin, cos, tan, ctan)
 template<class E>
-struct sin_expression : expression<sin_expression<E> > {
-    sin_expression(const expression<E>& e) : e(e.self()) {}
+struct sin_expression : expression_base {
     template <typename T, std::size_t M>
     T operator()(const std::array<T, M>& x) const {
-        return std::sin(e(x));
+        using std::sin;
+        return sin(e(x));
     }
-    const E e;
+    [[no_unique_address]] const E e;
 };
-template<class E>
-sin_expression<E> sin(const expression<E>& e) {
-        return sin_expression<E>(e);
+template<expression_node E>
+sin_expression<E> sin(const E& e) {
+    return sin_expression<E>{{}, e};
 }
 
 template<class E>
-struct cos_expression : expression<cos_expression<E> > {
-    cos_expression(const expression<E>& e) : e(e.self()) {}
+struct cos_expression : expression_base {
     template <typename T, std::size_t M>
     T operator()(const std::array<T, M>& x) const {
-        return std::cos(e(x));
+        using std::cos;
+        return cos(e(x));
     }
-    const E e;
+    [[no_unique_address]] const E e;
 };
-template<class E>
-cos_expression<E> cos(const expression<E>& e) {
-    return cos_expression<E>(e);
+template<expression_node E>
+cos_expression<E> cos(const E& e) {
+    return cos_expression<E>{{}, e};
 }
 
 template<class E>
-struct tg_expression : expression<tg_expression<E> > {
-    tg_expression(const expression<E>& e) : e(e.self()) {}
+struct tg_expression : expression_base {
     template <typename T, std::size_t M>
     T operator()(const std::array<T, M>& x) const {
-        return std::tan(e(x));
+        using std::tan;
+        return tan(e(x));
     }
-    const E e;
+    [[no_unique_address]] const E e;
 };
-template<class E>
-tg_expression<E> tan(const expression<E>& e) {
-    return tg_expression<E>(e);
+template<expression_node E>
+tg_expression<E> tan(const E& e) {
+    return tg_expression<E>{{}, e};
 }
 
 template<class E>
-struct ctg_expression : expression<ctg_expression<E> > {
-    ctg_expression(const expression<E>& e) : e(e.self()) {}
+struct ctg_expression : expression_base {
     template <typename T, std::size_t M>
     T operator()(const std::array<T, M>& x) const {
-        return 1 / std::tan(e(x));
+        using std::tan;
+        return 1 / tan(e(x));
     }
-    const E e;
+    [[no_unique_address]] const E e;
 };
-template<class E>
-ctg_expression<E> ctan(const expression<E>& e) {
-    return ctg_expression<E>(e);
+template<expression_node E>
+ctg_expression<E> ctan(const E& e) {
+    return ctg_expression<E>{{}, e};
 }
 // Exponent (exp, log)
 template<class E>
-struct exp_expression : expression<exp_expression<E> > {
-    exp_expression(const expression<E>& e) : e(e.self()) {}
+struct exp_expression : expression_base {
     template <typename T, std::size_t M>
     T operator()(const std::array<T, M>& x) const {
-        return std::exp(e(x));
+        using std::exp;
+        return exp(e(x));
     }
-    const E e;
+    [[no_unique_address]] const E e;
 };
-template<class E>
-exp_expression<E> exp(const expression<E>& e) {
-    return exp_expression<E>(e);
+template<expression_node E>
+exp_expression<E> exp(const E& e) {
+    return exp_expression<E>{{}, e};
 }
 
 template<class E>
-struct log_expression : expression<log_expression<E> > {
-    log_expression(const expression<E>& e) : e(e.self()) {}
+struct log_expression : expression_base {
     template <typename T, std::size_t M>
     T operator()(const std::array<T, M>& x) const {
         //natural log (base = e ~ 2.72)
-        return std::log(e(x));
+        using std::log;
+        return log(e(x));
     }
-    const E e;
+    [[no_unique_address]] const E e;
 };
-template<class E>
-log_expression<E> log(const expression<E>& e) {
-    return log_expression<E>(e);
+template<expression_node E>
+log_expression<E> log(const E& e) {
+    return log_expression<E>{{}, e};
 }
 
 // Other (sqrt, sqr, sign, abs, pow)
 template<class E>
-struct sqrt_expression : expression<sqrt_expression<E> > {
-    sqrt_expression(const expression<E>& e) : e(e.self()) {}
+struct sqrt_expression : expression_base {
     template <typename T, std::size_t M>
     T operator()(const std::array<T, M>& x) const {
-        return std::sqrt(e(x));
+        using std::sqrt;
+        return sqrt(e(x));
     }
-    const E e;
+    [[no_unique_address]] const E e;
 };
-template<class E>
-sqrt_expression<E> sqrt(const expression<E>& e) {
-    return sqrt_expression<E>(e);
+template<expression_node E>
+sqrt_expression<E> sqrt(const E& e) {
+    return sqrt_expression<E>{{}, e};
 }
 
 template<class E>
-struct sqr_expression : expression<sqr_expression<E> > {
-    sqr_expression(const expression<E>& e) : e(e.self()) {}
+struct sqr_expression : expression_base {
     template <typename T, std::size_t M>
     T operator()(const std::array<T, M>& x) const {
-        return e(x) * e(x);
+        using utils::sqr;
+        return sqr(e(x));
     }
-    const E e;
+    [[no_unique_address]] const E e;
 };
-template<class E>
-sqr_expression<E> sqr(const expression<E>& e) {
-    return sqr_expression<E>(e);
+template<expression_node E>
+sqr_expression<E> sqr(const E& e) {
+    return sqr_expression<E>{{}, e};
 }
 
 template<class E>
-struct sign_expression : expression<sign_expression<E> > {
-    sign_expression(const expression<E>& e) : e(e.self()) {}
+struct sign_expression : expression_base {
     template <typename T, std::size_t M>
     T operator()(const std::array<T, M>& x) const {
-        return (e(x) > 0) ? 1 : ((e(x) < 0) ? -1 : 0);
+        const T value = e(x);
+        return pack_traits<T>::select(value > 0, T(1), pack_traits<T>::select(value < 0, T(-1), T(0)));
     }
-    const E e;
+    [[no_unique_address]] const E e;
 };
-template<class E>
-sign_expression<E> sign(const expression<E>& e) {
-    return sign_expression<E>(e);
+template<expression_node E>
+sign_expression<E> sign(const E& e) {
+    return sign_expression<E>{{}, e};
 }
 
 template<class E>
-struct abs_expression : expression<abs_expression<E> > {
-    abs_expression(const expression<E>& e) : e(e.self()) {}
+struct abs_expression : expression_base {
     template <typename T, std::size_t M>
     T operator()(const std::array<T, M>& x) const {
-        return std::abs(e(x));
+        using std::abs;
+        return abs(e(x));
     }
-    const E e;
+    [[no_unique_address]] const E e;
 };
-template<class E>
-abs_expression<E> abs(const expression<E>& e) {
-    return abs_expression<E>(e);
+template<expression_node E>
+abs_expression<E> abs(const E& e) {
+    return abs_expression<E>{{}, e};
+}
+
+template<class E1, class E2>
+struct pow_expression : expression_base {
+    template <typename T, std::size_t M>
+    T operator()(const std::array<T, M>& x) const {
+        using std::pow;
+        return pow(e1(x), e2(x));
+    }
+    [[no_unique_address]] const E1 e1;
+    [[no_unique_address]] const E2 e2;
+};
+template<expression_node E1, expression_node E2>
+pow_expression<E1, E2> pow(const E1& e1, const E2& e2) {
+    return pow_expression<E1, E2>{{}, e1, e2};
+}
+
+// Integer power is computed by squaring instead of std::pow.
+template<class E, int N>
+struct powi_expression : expression_base {
+    template <typename T, std::size_t M>
+    T operator()(const std::array<T, M>& x) const {
+        using utils::powi;
+        return powi(T(e(x)), N);
+    }
+    [[no_unique_address]] const E e;
+};
+template<expression_node E, int N>
+powi_expression<E, N> pow(const E& e, const int_constant<N>&) {
+    return powi_expression<E, N>{{}, e};
+}
+
+// Fused and two arguments functions (fma, hypot, atan2)
+template<class E1, class E2, class E3>
+struct fma_expression : expression_base {
+    template <typename T, std::size_t M>
+    T operator()(const std::array<T, M>& x) const {
+        using std::fma;
+        return fma(T(e1(x)), T(e2(x)), T(e3(x)));
+    }
+    [[no_unique_address]] const E1 e1;
+    [[no_unique_address]] const E2 e2;
+    [[no_unique_address]] const E3 e3;
+};
+template<expression_node E1, expression_node E2, expression_node E3>
+fma_expression<E1, E2, E3> fma(const E1& e1, const E2& e2, const E3& e3) {
+    return fma_expression<E1, E2, E3>{{}, e1, e2, e3};
 }
 
 template<class E1, class E2>
-struct pow_expression : expression<pow_expression<E1, E2> > {
-    pow_expression(const expression<E1>& e1, const expression<E2>& e2) : e1(e1.self()), e2(e2.self()) {}
+struct hypot_expression : expression_base {
     template <typename T, std::size_t M>
     T operator()(const std::array<T, M>& x) const {
-        return std::pow(e1(x), e2(x));
+        using std::hypot;
+        return hypot(T(e1(x)), T(e2(x)));
     }
-    const E1 e1;
-    const E2 e2;
+    [[no_unique_address]] const E1 e1;
+    [[no_unique_address]] const E2 e2;
 };
+template<expression_node E1, expression_node E2>
+hypot_expression<E1, E2> hypot(const E1& e1, const E2& e2) {
+    return hypot_expression<E1, E2>{{}, e1, e2};
+}
+
 template<class E1, class E2>
-pow_expression<E1, E2> pow(const expression<E1>& e1, const expression<E2>& e2) {
-    return pow_expression<E1, E2>(e1, e2);
+struct atan2_expression : expression_base {
+    template <typename T, std::size_t M>
+    T operator()(const std::array<T, M>& x) const {
+        using std::atan2;
+        return atan2(T(e1(x)), T(e2(x)));
+    }
+    [[no_unique_address]] const E1 e1;
+    [[no_unique_address]] const E2 e2;
+};
+template<expression_node E1, expression_node E2>
+atan2_expression<E1, E2> atan2(const E1& e1, const E2& e2) {
+    return atan2_expression<E1, E2>{{}, e1, e2};
 }
 
 }
@@ -0,0 +1,111 @@
+#include "functions.hpp"
+#include "parser.hpp"
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+
+namespace parser {
+
+void function_library::define(const std::string& name, const std::string& body) {
+    if (name.empty() || !std::isalpha(static_cast<unsigned char>(name.front())))
+        throw std::domain_error{"Wrong function name <" + name + ">. Function name must start with latin letter."};
+    for (const char symbol : name)
+        if (!std::isalnum(static_cast<unsigned char>(symbol)))
+            throw std::domain_error{"Wrong function name <" + name + ">. Only latin letters and digits are allowed."};
+    if (get_arithmetic_operators().contains(name))
+        throw std::domain_error{"Wrong function name <" + name + ">. It is a built-in function."};
+
+    // the body is parsed without lock, it may call other functions of the library
+    const MathParser formula(body, *this);
+    if (formula.variables_count() == 0)
+        throw std::domain_error{"Function <" + name + "> must have at least one parameter."};
+    auto function = std::make_shared<user_function>();
+    function->arity = formula.variables_count();
+    function->body = build_tree(formula._polish_notation, formula._variables, this);
+
+    std::unique_lock lock(_mutex);
+    auto& slot = _functions[name];
+    if (slot && slot->arity != function->arity)
+        throw std::domain_error{"Function <" + name + "> is already defined with " + std::to_string(slot->arity) + " parameters."};
+    slot = std::move(function);
+}
+
+std::shared_ptr<const user_function> function_library::find(const std::string& name) const {
+    std::shared_lock lock(_mutex);
+    const auto it = _functions.find(name);
+    return it == _functions.end() ? nullptr : it->second;
+}
+
+bool function_library::contains(const std::string& name) const {
+    std::shared_lock lock(_mutex);
+    return _functions.contains(name);
+}
+
+std::size_t function_library::size() const {
+    std::shared_lock lock(_mutex);
+    return _functions.size();
+}
+
+std::vector<std::string> function_library::names() const {
+    std::shared_lock lock(_mutex);
+    std::vector<std::string> res;
+    res.reserve(_functions.size());
+    for (const auto& [name, _] : _functions)
+        res.push_back(name);
+    return res;
+}
+
+namespace {
+
+// shared arguments are visited once, they are computed once
+void count_uses(const node& tree, std::vector<std::size_t>& uses, std::set<const shared_tree*>& visited) {
+    if (tree.op == operator_index::variable)
+        ++uses[static_cast<std::size_t>(tree.index)];
+    else if (tree.op == operator_index::argument && visited.insert(tree.shared.get()).second)
+        count_uses(tree.shared->tree, uses, visited);
+    for (const node& arg : tree.args)
+        count_uses(arg, uses, visited);
+}
+
+// shared arguments of the body get one copy per call, copies maps them to it
+node substitute(const node& body, const std::vector<node>& arguments, std::map<const shared_tree*, std::shared_ptr<shared_tree>>& copies) {
+    if (body.op == operator_index::variable)
+        return arguments[static_cast<std::size_t>(body.index)];
+    node res;
+    res.op = body.op;
+    res.value = body.value;
+    res.index = body.index;
+    res.coefficients = body.coefficients;
+    if (body.op == operator_index::argument) {
+        auto& copy = copies[body.shared.get()];
+        if (!copy)
+            copy = std::make_shared<shared_tree>(shared_tree{substitute(body.shared->tree, arguments, copies)});
+        res.shared = copy;
+        return res;
+    }
+    res.args.reserve(body.args.size());
+    for (const node& arg : body.args)
+        res.args.push_back(substitute(arg, arguments, copies));
+    return res;
+}
+
+}
+
+node inline_call(const node& body, std::vector<node> arguments) {
+    std::vector<std::size_t> uses(arguments.size(), 0);
+    std::set<const shared_tree*> visited;
+    count_uses(body, uses, visited);
+    for (std::size_t k = 0; k < arguments.size(); ++k)
+        if (uses[k] > 1 && !arguments[k].args.empty()) {
+            node reference;
+            reference.op = operator_index::argument;
+            reference.shared = std::make_shared<shared_tree>(shared_tree{std::move(arguments[k])});
+            arguments[k] = std::move(reference);
+        }
+    std::map<const shared_tree*, std::shared_ptr<shared_tree>> copies;
+    return substitute(body, arguments, copies);
+}
+
+}
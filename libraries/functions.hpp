@@ -0,0 +1,45 @@
+#pragma once
+
+#include "program.hpp"
+
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Named functions defined by formulas: define("discount", "r t : exp(-r * t)") makes discount(r, t) callable from
+// other formulas compiled with the library. Calls are inlined: the cached tree of the body is copied into the
+// caller with parameters replaced by arguments before optimization, so folding, fusion and common subexpressions
+// work across the call. The library is shared by many formulas and threads, a formula keeps the bodies it was
+// compiled with.
+namespace parser {
+
+struct user_function {
+    std::size_t arity;
+    // parameters are variable nodes with index of the parameter
+    node body;
+};
+
+class function_library {
+public:
+    // Parameters are variables of the body formula in the order of declaration. The body may call functions
+    // defined earlier. Redefinition must keep the number of parameters.
+    void define(const std::string& name, const std::string& body);
+
+    // nullptr if there is no such function
+    std::shared_ptr<const user_function> find(const std::string& name) const;
+    bool contains(const std::string& name) const;
+    std::size_t size() const;
+    std::vector<std::string> names() const;
+
+private:
+    mutable std::shared_mutex _mutex;
+    std::unordered_map<std::string, std::shared_ptr<const user_function>> _functions;
+};
+
+// Copy of body with parameter nodes replaced by arguments. Arguments which the body uses several times are shared
+// by their references instead of being copied, so nested calls do not grow the tree exponentially.
+node inline_call(const node& body, std::vector<node> arguments);
+
+}
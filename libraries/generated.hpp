@@ -0,0 +1,32 @@
+#pragma once
+
+#include "expression.hpp"
+#include "utils.hpp"
+
+#include <array>
+#include <span>
+#include <string_view>
+
+// Formulas compiled ahead of time by FormulaCodegen, see add_formula_header in cmake/formula_codegen.cmake.
+// Every generated header keeps the table of its formulas in its own namespace.
+namespace parser {
+
+struct generated_formula {
+    std::string_view name;
+    // |variables : expression| text the formula was generated from
+    std::string_view source;
+    std::size_t variables_count;
+    double (*evaluate)(std::span<const double>);
+    // columns[j][i] is value of variable j in row i
+    void (*evaluate_batch)(std::span<const std::span<const double>>, std::span<double>);
+};
+
+template<std::size_t N>
+const generated_formula* find_generated(const std::array<generated_formula, N>& formulas, std::string_view name) {
+    for (const generated_formula& formula : formulas)
+        if (formula.name == name)
+            return &formula;
+    return nullptr;
+}
+
+}
@@ -0,0 +1,394 @@
+#pragma once
+
+#include "batch.hpp"
+#include "parser.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <concepts>
+#include <cstdint>
+#include <limits>
+#include <numbers>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+// Interval evaluation: every value is a range [lower, upper] which contains results of the formula for all inputs
+// from the input ranges. Bounds are rounded outward: results of correctly rounded operations (+, -, *, /, sqrt, fma)
+// are widened by one ulp, results of libm functions by several ulps which cover their documented errors. Functions
+// which are not monotone (sin, cos, tan, cosh, abs, tgamma, lgamma, pow, atan2) take their extrema and poles inside
+// the range into account. Points outside of the domain are dropped, sqrt([-1, 4]) is [0, 2], division by a range
+// containing zero gives the whole line. An empty range has NaN bounds.
+namespace parser {
+
+// Possible results of a comparison of ranges.
+struct interval_mask {
+    bool may_be_false = false;
+    bool may_be_true = false;
+};
+
+template<std::floating_point T>
+struct interval {
+    T lower = T(0);
+    T upper = T(0);
+
+    constexpr interval() = default;
+    constexpr interval(T point) : lower(point), upper(point) {}
+    constexpr interval(T lower, T upper) : lower(lower), upper(upper) {}
+    // result of comparison as 0 or 1
+    constexpr explicit interval(const interval_mask& mask) : lower(mask.may_be_false ? T(0) : T(1)), upper(mask.may_be_true ? T(1) : T(0)) {}
+
+    static constexpr interval whole() {
+        return {-std::numeric_limits<T>::infinity(), std::numeric_limits<T>::infinity()};
+    }
+    static constexpr interval none() {
+        return {std::numeric_limits<T>::quiet_NaN(), std::numeric_limits<T>::quiet_NaN()};
+    }
+
+    bool empty() const {
+        return !(lower <= upper);
+    }
+    bool contains(T x) const {
+        return lower <= x && x <= upper;
+    }
+    T width() const {
+        return upper - lower;
+    }
+    // smallest and largest absolute values
+    T mignitude() const {
+        return contains(T(0)) ? T(0) : std::min(std::abs(lower), std::abs(upper));
+    }
+    T magnitude() const {
+        return std::max(std::abs(lower), std::abs(upper));
+    }
+
+    interval& operator+=(const interval& b) { return *this = *this + b; }
+    interval& operator-=(const interval& b) { return *this = *this - b; }
+    interval& operator*=(const interval& b) { return *this = *this * b; }
+    interval& operator/=(const interval& b) { return *this = *this / b; }
+
+    // hidden friends, so that constants convert to intervals and std functions are not considered
+    friend interval operator+(const interval& a, const interval& b) {
+        return rounded(a.lower + b.lower, a.upper + b.upper);
+    }
+    friend interval operator-(const interval& a, const interval& b) {
+        return rounded(a.lower - b.upper, a.upper - b.lower);
+    }
+    friend interval operator-(const interval& a) {
+        return {-a.upper, -a.lower};
+    }
+    friend interval operator*(const interval& a, const interval& b) {
+        if (a.empty() || b.empty())
+            return none();
+        // 0 * inf is 0 here, the range does not contain infinity itself
+        const auto product = [](T x, T y) { return x == 0 || y == 0 ? T(0) : x * y; };
+        return hull_of({product(a.lower, b.lower), product(a.lower, b.upper), product(a.upper, b.lower), product(a.upper, b.upper)}, 1);
+    }
+    friend interval operator/(const interval& a, const interval& b) {
+        if (a.empty() || b.empty())
+            return none();
+        if (b.contains(T(0)))
+            return whole();
+        return hull_of({a.lower / b.lower, a.lower / b.upper, a.upper / b.lower, a.upper / b.upper}, 1);
+    }
+
+    friend interval_mask operator<(const interval& a, const interval& b) {
+        return {!(a.upper < b.lower), a.lower < b.upper};
+    }
+    friend interval_mask operator<=(const interval& a, const interval& b) {
+        return {!(a.upper <= b.lower), a.lower <= b.upper};
+    }
+    friend interval_mask operator>(const interval& a, const interval& b) {
+        return b < a;
+    }
+    friend interval_mask operator>=(const interval& a, const interval& b) {
+        return b <= a;
+    }
+    friend interval_mask operator==(const interval& a, const interval& b) {
+        const bool same_point = a.lower == a.upper && b.lower == b.upper && a.lower == b.lower;
+        return {!same_point, a.lower <= b.upper && b.lower <= a.upper};
+    }
+    friend interval_mask operator!=(const interval& a, const interval& b) {
+        const interval_mask equal = a == b;
+        return {equal.may_be_true, equal.may_be_false};
+    }
+
+    friend interval select(const interval_mask& mask, const interval& a, const interval& b) {
+        if (!mask.may_be_false)
+            return a;
+        if (!mask.may_be_true)
+            return b;
+        return hull(a, b);
+    }
+    friend interval min(const interval& a, const interval& b) {
+        if (a.empty() || b.empty())
+            return none();
+        return {std::min(a.lower, b.lower), std::min(a.upper, b.upper)};
+    }
+    friend interval max(const interval& a, const interval& b) {
+        if (a.empty() || b.empty())
+            return none();
+        return {std::max(a.lower, b.lower), std::max(a.upper, b.upper)};
+    }
+    // smallest range which contains both, empty ranges are ignored
+    friend interval hull(const interval& a, const interval& b) {
+        return {std::fmin(a.lower, b.lower), std::fmax(a.upper, b.upper)};
+    }
+
+    friend interval sqr(const interval& a) {
+        const T m = a.mignitude(), M = a.magnitude();
+        return clip(rounded(m * m, M * M), T(0), inf());
+    }
+    friend interval powi(const interval& a, std::int32_t exponent) {
+        if (exponent == 0)
+            return T(1);
+        if (exponent < 0)
+            return interval(T(1)) / power(a, -std::int64_t(exponent));
+        return power(a, exponent);
+    }
+    friend interval fma(const interval& a, const interval& b, const interval& c) {
+        return a * b + c;
+    }
+
+    friend interval sqrt(const interval& a) {
+        const interval x = restrict(a, T(0), inf());
+        return clip(rounded(std::sqrt(x.lower), std::sqrt(x.upper)), T(0), inf());
+    }
+    friend interval cbrt(const interval& a) { return increasing(a, [](T x) { return std::cbrt(x); }); }
+    friend interval exp(const interval& a) { return clip(increasing(a, [](T x) { return std::exp(x); }), T(0), inf()); }
+    friend interval exp2(const interval& a) { return clip(increasing(a, [](T x) { return std::exp2(x); }), T(0), inf()); }
+    friend interval expm1(const interval& a) { return clip(increasing(a, [](T x) { return std::expm1(x); }), T(-1), inf()); }
+    friend interval log(const interval& a) { return increasing(restrict(a, T(0), inf()), [](T x) { return std::log(x); }); }
+    friend interval log10(const interval& a) { return increasing(restrict(a, T(0), inf()), [](T x) { return std::log10(x); }); }
+    friend interval log2(const interval& a) { return increasing(restrict(a, T(0), inf()), [](T x) { return std::log2(x); }); }
+    friend interval log1p(const interval& a) { return increasing(restrict(a, T(-1), inf()), [](T x) { return std::log1p(x); }); }
+    friend interval sinh(const interval& a) { return increasing(a, [](T x) { return std::sinh(x); }); }
+    friend interval tanh(const interval& a) { return clip(increasing(a, [](T x) { return std::tanh(x); }), T(-1), T(1)); }
+    friend interval asinh(const interval& a) { return increasing(a, [](T x) { return std::asinh(x); }); }
+    friend interval acosh(const interval& a) { return clip(increasing(restrict(a, T(1), inf()), [](T x) { return std::acosh(x); }), T(0), inf()); }
+    friend interval atanh(const interval& a) { return increasing(restrict(a, T(-1), T(1)), [](T x) { return std::atanh(x); }); }
+    friend interval asin(const interval& a) { return increasing(restrict(a, T(-1), T(1)), [](T x) { return std::asin(x); }); }
+    friend interval acos(const interval& a) {
+        const interval x = restrict(a, T(-1), T(1));
+        return clip(rounded(std::acos(x.upper), std::acos(x.lower), elementary_ulps), T(0), inf());
+    }
+    friend interval atan(const interval& a) { return increasing(a, [](T x) { return std::atan(x); }); }
+    friend interval erf(const interval& a) { return clip(increasing(a, [](T x) { return std::erf(x); }), T(-1), T(1)); }
+    friend interval erfc(const interval& a) {
+        return clip(rounded(std::erfc(a.upper), std::erfc(a.lower), elementary_ulps), T(0), T(2));
+    }
+    // step functions are exact
+    friend interval ceil(const interval& a) { return {std::ceil(a.lower), std::ceil(a.upper)}; }
+    friend interval floor(const interval& a) { return {std::floor(a.lower), std::floor(a.upper)}; }
+    friend interval trunc(const interval& a) { return {std::trunc(a.lower), std::trunc(a.upper)}; }
+    friend interval round(const interval& a) { return {std::round(a.lower), std::round(a.upper)}; }
+    friend interval abs(const interval& a) {
+        if (a.empty())
+            return none();
+        return {a.mignitude(), a.magnitude()};
+    }
+    friend interval cosh(const interval& a) {
+        if (a.empty())
+            return none();
+        return clip(rounded(std::cosh(a.mignitude()), std::cosh(a.magnitude()), elementary_ulps), T(1), inf());
+    }
+
+    // maxima of cos are at 2 k pi, minima at pi + 2 k pi
+    friend interval cos(const interval& a) {
+        return periodic(a, [](T x) { return std::cos(x); }, T(0), pi());
+    }
+    friend interval sin(const interval& a) {
+        return periodic(a, [](T x) { return std::sin(x); }, pi() / 2, -pi() / 2);
+    }
+    // increasing between poles at pi / 2 + k pi
+    friend interval tan(const interval& a) {
+        if (a.empty())
+            return none();
+        if (!std::isfinite(a.lower) || !std::isfinite(a.upper) || may_hit(a, pi() / 2, pi()))
+            return whole();
+        return increasing(a, [](T x) { return std::tan(x); });
+    }
+
+    friend interval tgamma(const interval& a) {
+        return gamma_like(a, [](T x) { return std::tgamma(x); });
+    }
+    friend interval lgamma(const interval& a) {
+        return gamma_like(a, [](T x) { return std::lgamma(x); });
+    }
+
+    // pow(x, y) is monotone in x and in y for x >= 0, so its extrema over the box are at the corners.
+    // Negative base has real powers only for integer exponents, see negative_pow.
+    friend interval pow(const interval& a, const interval& b) {
+        if (a.empty() || b.empty())
+            return none();
+        if (b.lower == b.upper && std::trunc(b.lower) == b.lower && std::abs(b.lower) <= T(std::numeric_limits<std::int32_t>::max()))
+            return powi(a, static_cast<std::int32_t>(b.lower));
+        interval res = a.lower < 0 ? negative_pow({a.lower, std::fmin(a.upper, T(0))}, b) : none();
+        if (a.upper >= 0) {
+            const T lower = std::fmax(a.lower, T(0));
+            res = hull(res, clip(hull_of({std::pow(lower, b.lower), std::pow(lower, b.upper), std::pow(a.upper, b.lower), std::pow(a.upper, b.upper)},
+                                         elementary_ulps), T(0), inf()));
+        }
+        return res;
+    }
+    friend interval hypot(const interval& a, const interval& b) {
+        if (a.empty() || b.empty())
+            return none();
+        return clip(rounded(std::hypot(a.mignitude(), b.mignitude()), std::hypot(a.magnitude(), b.magnitude()), elementary_ulps), T(0), inf());
+    }
+    // Angle is continuous on a box which does not touch the cut along the negative x axis, then its extrema are at the corners.
+    friend interval atan2(const interval& y, const interval& x) {
+        if (y.empty() || x.empty())
+            return none();
+        const T bound = std::nextafter(pi(), inf());
+        if (y.contains(T(0)) && x.lower <= 0)
+            return {-bound, bound};
+        return clip(hull_of({std::atan2(y.lower, x.lower), std::atan2(y.lower, x.upper), std::atan2(y.upper, x.lower), std::atan2(y.upper, x.upper)},
+                            elementary_ulps), -bound, bound);
+    }
+
+private:
+    // libm functions are not correctly rounded, ulps cover their errors
+    static constexpr int elementary_ulps = 4;
+    static constexpr int gamma_ulps = 16;
+
+    static constexpr T inf() {
+        return std::numeric_limits<T>::infinity();
+    }
+    static constexpr T pi() {
+        return std::numbers::pi_v<T>;
+    }
+    static interval rounded(T lower, T upper, int ulps = 1) {
+        for (int k = 0; k < ulps; ++k) {
+            lower = std::nextafter(lower, -inf());
+            upper = std::nextafter(upper, inf());
+        }
+        return {lower, upper};
+    }
+    static interval hull_of(const std::array<T, 4>& values, int ulps) {
+        return rounded(*std::min_element(values.begin(), values.end()), *std::max_element(values.begin(), values.end()), ulps);
+    }
+    // intersection with the range of the function, NaN bounds stay NaN
+    static interval clip(const interval& a, T lower, T upper) {
+        return {std::max(a.lower, lower), std::min(a.upper, upper)};
+    }
+    // intersection with the domain of the function
+    static interval restrict(const interval& a, T lower, T upper) {
+        const interval res = clip(a, lower, upper);
+        return res.empty() ? none() : res;
+    }
+    // x^n for n > 0, even powers have minimum at zero
+    static interval power(const interval& a, std::int64_t n) {
+        if (a.empty())
+            return none();
+        if (n % 2 == 0) {
+            const T m = a.mignitude(), M = a.magnitude();
+            return clip(rounded(std::pow(m, T(n)), std::pow(M, T(n)), elementary_ulps), T(0), inf());
+        }
+        return rounded(std::pow(a.lower, T(n)), std::pow(a.upper, T(n)), elementary_ulps);
+    }
+    // x^k for x <= 0 and integers k in b, other exponents give no real values. A few exponents are joined one by
+    // one, otherwise signs alternate and |x|^k is monotone in |x| and in k, so the magnitude is bounded at the corners.
+    static interval negative_pow(const interval& a, const interval& b) {
+        static constexpr T max_exponent = T(std::numeric_limits<std::int32_t>::max());
+        const T first = std::ceil(b.lower), last = std::floor(b.upper);
+        if (first > last)
+            return none();
+        if (last - first < 4 && std::abs(first) <= max_exponent && std::abs(last) <= max_exponent) {
+            interval res = none();
+            for (T k = first; k <= last; ++k)
+                res = hull(res, powi(a, static_cast<std::int32_t>(k)));
+            return res;
+        }
+        const T m = a.mignitude(), M = a.magnitude();
+        const T bound = hull_of({std::pow(m, first), std::pow(m, last), std::pow(M, first), std::pow(M, last)}, elementary_ulps).upper;
+        return {-bound, bound};
+    }
+    template<class F>
+    static interval increasing(const interval& a, F f) {
+        return rounded(f(a.lower), f(a.upper), elementary_ulps);
+    }
+
+    // Whether offset + k * period may lie in a for some integer k. Rounding errors of the division and
+    // of the period are covered by the margin, so the answer may be wrongly yes but never wrongly no.
+    static bool may_hit(const interval& a, T offset, T period) {
+        const T from = (a.lower - offset) / period, to = (a.upper - offset) / period;
+        const T margin = T(1e-12) * (T(1) + std::max(std::abs(from), std::abs(to)));
+        return std::floor(to + margin) >= std::ceil(from - margin);
+    }
+    // f has period 2 pi with maximum 1 at maximum + 2 k pi and minimum -1 at minimum + 2 k pi
+    template<class F>
+    static interval periodic(const interval& a, F f, T maximum, T minimum) {
+        if (a.empty())
+            return none();
+        if (!std::isfinite(a.lower) || !std::isfinite(a.upper))
+            return {T(-1), T(1)};
+        interval res = rounded(std::min(f(a.lower), f(a.upper)), std::max(f(a.lower), f(a.upper)), elementary_ulps);
+        if (may_hit(a, minimum, 2 * pi()))
+            res.lower = T(-1);
+        if (may_hit(a, maximum, 2 * pi()))
+            res.upper = T(1);
+        return clip(res, T(-1), T(1));
+    }
+
+    // tgamma and lgamma have poles at non-positive integers and one extremum between neighbouring poles
+    // and on (0, inf), where digamma changes its sign. Ranges containing a pole give the whole line.
+    template<class F>
+    static interval gamma_like(const interval& a, F f) {
+        if (a.empty())
+            return none();
+        const T left = a.lower > 0 ? T(0) : std::floor(a.lower);
+        const T right = a.lower > 0 ? inf() : left + 1;
+        if (!(left < a.lower && a.upper < right))
+            return whole();
+        interval res = rounded(std::min(f(a.lower), f(a.upper)), std::max(f(a.lower), f(a.upper)), gamma_ulps);
+        const T extremum = digamma_root(a.lower > 0 ? T(1) : left, a.lower > 0 ? T(2) : right);
+        if (a.contains(extremum)) {
+            // f is flat at the extremum, error of its position changes the value in the second order only
+            const T value = f(extremum);
+            const T margin = T(1e-10) * std::abs(value) + std::numeric_limits<T>::min();
+            res = hull(res, interval(value - margin, value + margin));
+        }
+        return res;
+    }
+    // digamma increases from -inf to inf between its poles, its root is found by bisection
+    static T digamma_root(T left, T right) {
+        while (true) {
+            const T middle = left + (right - left) / 2;
+            if (middle <= left || middle >= right)
+                return middle;
+            (utils::digamma(double(middle)) < 0 ? left : right) = middle;
+        }
+    }
+};
+
+// Bounds of the formula over the box, box[j] is the range of variable j, see get_variables().
+template<std::floating_point T>
+interval<T> bound(const MathParser& formula, const std::span<const interval<T>> box) {
+    if (box.size() != formula.get_variables().size())
+        throw std::domain_error{"Wrong number of variables."};
+    return formula.get_program().evaluate(box);
+}
+
+// Bounds of the formula over many boxes: columns[j][i] is the range of variable j in box i, out[i] receives the bounds of box i.
+template<std::floating_point T>
+void bound_batch(const MathParser& formula, const std::span<const std::span<const interval<T>>> columns, const std::span<interval<T>> out,
+                 std::size_t threads = 1) {
+    if (columns.size() != formula.get_variables().size())
+        throw std::domain_error{"Wrong number of columns."};
+    for (const auto& column : columns)
+        if (column.size() < out.size())
+            throw std::domain_error{"Wrong number of rows. Every column must contain at least as many values as output."};
+    const program& compiled = formula.get_program();
+    for_each_range(out.size(), batch_chunk_size, threads, [&](std::size_t first, std::size_t count) {
+        std::vector<interval<T>> box(columns.size());
+        for (std::size_t i = first; i < first + count; ++i) {
+            for (std::size_t j = 0; j < columns.size(); ++j)
+                box[j] = columns[j][i];
+            out[i] = compiled.evaluate(std::span<const interval<T>>(box));
+        }
+    });
+}
+
+}
@@ -0,0 +1,170 @@
+#include "jacobian.hpp"
+
+#include "batch.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace parser {
+
+formula_system::formula_system(std::vector<std::string> variables, const std::vector<MathParser>& formulas)
+    : _variables(std::move(variables)) {
+    std::unordered_map<std::string, std::uint32_t> columns;
+    for (std::size_t j = 0; j < _variables.size(); ++j)
+        if (!columns.emplace(_variables[j], static_cast<std::uint32_t>(j)).second)
+            throw std::domain_error{"Variable <" + _variables[j] + "> of the system is declared twice."};
+
+    _row_offsets.push_back(0);
+    for (std::size_t i = 0; i < formulas.size(); ++i) {
+        // slots of the formula are redirected to columns of the system
+        const auto slots = formulas[i].get_variables();
+        std::vector<std::uint32_t> slot_columns(slots.size(), 0);
+        for (const auto& [name, slot] : slots) {
+            const auto it = columns.find(name);
+            if (it == columns.end())
+                throw std::domain_error{"Variable <" + name + "> of formula " + std::to_string(i) + " is not a variable of the system."};
+            slot_columns[slot] = it->second;
+        }
+        const program& compiled = formulas[i].get_program();
+        equation& e = _equations.emplace_back(equation{compiled.code(), compiled.constants()});
+        std::vector<std::size_t> row;
+        for (instruction& ins : e.code)
+            if (ins.op == operator_index::variable) {
+                ins.args[0] = slot_columns[ins.args[0]];
+                row.push_back(ins.args[0]);
+            }
+        std::sort(row.begin(), row.end());
+        row.erase(std::unique(row.begin(), row.end()), row.end());
+        _column_indices.insert(_column_indices.end(), row.begin(), row.end());
+        _row_offsets.push_back(_column_indices.size());
+    }
+    color_columns();
+}
+
+// Greedy coloring of the column intersection graph, columns with more nonzeros are colored first.
+void formula_system::color_columns() {
+    const std::size_t n = columns();
+    std::vector<std::vector<std::size_t>> column_rows(n);
+    for (std::size_t i = 0; i < rows(); ++i)
+        for (std::size_t k = _row_offsets[i]; k < _row_offsets[i + 1]; ++k)
+            column_rows[_column_indices[k]].push_back(i);
+
+    std::vector<std::size_t> order(n);
+    std::iota(order.begin(), order.end(), std::size_t(0));
+    std::stable_sort(order.begin(), order.end(), [&column_rows](std::size_t a, std::size_t b) {
+        return column_rows[a].size() > column_rows[b].size();
+    });
+
+    static constexpr std::size_t none = std::numeric_limits<std::size_t>::max();
+    _colors.assign(n, none);
+    // forbidden[c] == j if color c is taken by a neighbour of column j
+    std::vector<std::size_t> forbidden(n, none);
+    std::size_t count = 0;
+    for (const std::size_t j : order) {
+        for (const std::size_t i : column_rows[j])
+            for (std::size_t k = _row_offsets[i]; k < _row_offsets[i + 1]; ++k)
+                if (const std::size_t c = _colors[_column_indices[k]]; c != none)
+                    forbidden[c] = j;
+        std::size_t color = 0;
+        while (forbidden[color] == j)
+            ++color;
+        _colors[j] = color;
+        count = std::max(count, color + 1);
+    }
+
+    // columns without nonzeros do not need to be seeded
+    _color_columns.assign(count, {});
+    _color_entries.assign(count, {});
+    for (std::size_t j = 0; j < n; ++j)
+        if (!column_rows[j].empty())
+            _color_columns[_colors[j]].push_back(j);
+    for (std::size_t i = 0; i < rows(); ++i)
+        for (std::size_t k = _row_offsets[i]; k < _row_offsets[i + 1]; ++k)
+            _color_entries[_colors[_column_indices[k]]].push_back(entry{i, k});
+}
+
+std::size_t formula_system::rows() const {
+    return _equations.size();
+}
+
+std::size_t formula_system::columns() const {
+    return _variables.size();
+}
+
+std::size_t formula_system::nonzeros() const {
+    return _column_indices.size();
+}
+
+const std::vector<std::string>& formula_system::variables() const {
+    return _variables;
+}
+
+const std::vector<std::size_t>& formula_system::row_offsets() const {
+    return _row_offsets;
+}
+
+const std::vector<std::size_t>& formula_system::column_indices() const {
+    return _column_indices;
+}
+
+const std::vector<std::size_t>& formula_system::column_colors() const {
+    return _colors;
+}
+
+std::size_t formula_system::colors_count() const {
+    return _color_columns.size();
+}
+
+void formula_system::evaluate(const std::span<const double> x, const std::span<double> out) const {
+    if (x.size() != columns())
+        throw std::domain_error{"Wrong number of variables."};
+    if (out.size() != rows())
+        throw std::domain_error{"Wrong output size. Output must contain value for every formula."};
+    for (std::size_t i = 0; i < rows(); ++i)
+        out[i] = evaluate_row(i, x);
+}
+
+void formula_system::jacobian_point(const std::span<const double> x, const std::span<double> values, std::vector<dual<double>>& seeds) const {
+    for (std::size_t j = 0; j < x.size(); ++j)
+        seeds[j] = dual<double>(x[j]);
+    const std::span<const dual<double>> input(seeds);
+    for (std::size_t color = 0; color < colors_count(); ++color) {
+        for (const std::size_t j : _color_columns[color])
+            seeds[j].derivative = 1;
+        // every row has at most one column of the color, its derivative along the seed is that entry
+        for (const entry& e : _color_entries[color])
+            values[e.position] = evaluate_row(e.row, input).derivative;
+        for (const std::size_t j : _color_columns[color])
+            seeds[j].derivative = 0;
+    }
+}
+
+void formula_system::jacobian(const std::span<const double> x, const std::span<double> values) const {
+    if (x.size() != columns())
+        throw std::domain_error{"Wrong number of variables."};
+    if (values.size() != nonzeros())
+        throw std::domain_error{"Wrong output size. Output must contain every nonzero of the Jacobian."};
+    std::vector<dual<double>> seeds(columns());
+    jacobian_point(x, values, seeds);
+}
+
+void formula_system::jacobian_batch(const std::span<const double> points, const std::span<double> values, std::size_t threads) const {
+    const std::size_t n = columns();
+    const std::size_t count = n == 0 ? 0 : points.size() / n;
+    if (points.size() != count * n)
+        throw std::domain_error{"Wrong number of variables. Every point must contain value of every variable."};
+    if (values.size() != count * nonzeros())
+        throw std::domain_error{"Wrong output size. Output must contain every nonzero of the Jacobian for every point."};
+
+    // points of one range share the seeds
+    for_each_range(count, 64, threads, [&](std::size_t first, std::size_t size) {
+        std::vector<dual<double>> seeds(n);
+        for (std::size_t p = first; p < first + size; ++p)
+            jacobian_point(points.subspan(p * n, n), values.subspan(p * nonzeros(), nonzeros()), seeds);
+    });
+}
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "dual.hpp"
+#include "parser.hpp"
+
+#include <span>
+#include <string>
+#include <vector>
+
+// Sparse Jacobian of a system of formulas over shared variables. Sparsity pattern is taken from the variables
+// every compiled formula reads. Columns which do not share any row get the same color, and the Jacobian is evaluated
+// by one forward mode pass per color with dual numbers instead of one evaluation of the system per variable.
+namespace parser {
+
+class formula_system {
+public:
+    // Variables are columns of the Jacobian, formulas are its rows. Every variable of every formula must be
+    // among variables, formulas may use any subset of them.
+    formula_system(std::vector<std::string> variables, const std::vector<MathParser>& formulas);
+
+    std::size_t rows() const;
+    std::size_t columns() const;
+    std::size_t nonzeros() const;
+    const std::vector<std::string>& variables() const;
+
+    // CSR structure: entries of row i are [row_offsets()[i], row_offsets()[i + 1]), columns of a row are sorted.
+    const std::vector<std::size_t>& row_offsets() const;
+    const std::vector<std::size_t>& column_indices() const;
+    // Color of every column, one forward pass is done per color.
+    const std::vector<std::size_t>& column_colors() const;
+    std::size_t colors_count() const;
+
+    // out[i] is the value of formula i at x.
+    void evaluate(const std::span<const double> x, const std::span<double> out) const;
+    // Nonzero values of the Jacobian at x in CSR order.
+    void jacobian(const std::span<const double> x, const std::span<double> values) const;
+    // The same for many points with the same pattern. Points are rows of points (count * columns()),
+    // values of point p are values[p * nonzeros(), (p + 1) * nonzeros()).
+    void jacobian_batch(const std::span<const double> points, const std::span<double> values, std::size_t threads = 1) const;
+
+private:
+    struct equation {
+        std::vector<instruction> code;
+        std::vector<double> constants;
+    };
+    // nonzero of the Jacobian which is computed in the pass of its column color
+    struct entry {
+        std::size_t row;
+        std::size_t position;
+    };
+
+    template<typename T>
+    T evaluate_row(std::size_t row, const std::span<const T> x) const {
+        const equation& e = _equations[row];
+        return parser::evaluate(std::span<const instruction>(e.code), e.constants.data(), x);
+    }
+
+    void color_columns();
+    void jacobian_point(const std::span<const double> x, const std::span<double> values, std::vector<dual<double>>& seeds) const;
+
+    std::vector<std::string> _variables;
+    std::vector<equation> _equations;
+    std::vector<std::size_t> _row_offsets;
+    std::vector<std::size_t> _column_indices;
+    std::vector<std::size_t> _colors;
+    std::vector<std::vector<std::size_t>> _color_columns;
+    std::vector<std::vector<entry>> _color_entries;
+};
+
+}
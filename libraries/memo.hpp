@@ -0,0 +1,232 @@
+#pragma once
+
+#include "parser.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Memoization of formula results for repeated inputs. Keys are bit patterns of the whole input, so 0 and -0
+// are different keys and NaN inputs are cached as well. The table has fixed size and open addressing with short
+// linear probing, a full probe sequence evicts the entry at the home slot. Formulas which are cheaper than the
+// cost threshold are evaluated directly, looking up would take longer than computing.
+namespace parser {
+
+// Cost of formula in additions, see program::estimated_cost(), below which caching is skipped.
+inline constexpr std::size_t default_memo_min_cost = 40;
+
+struct memo_statistics {
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+    // calls of formulas below the cost threshold
+    std::size_t bypassed = 0;
+
+    double hit_rate() const {
+        return hits + misses == 0 ? 0. : double(hits) / double(hits + misses);
+    }
+};
+
+// Inputs are keyed on their bit patterns, so a value must fit the 64-bit word of the hash: long double with its
+// padding bytes is not a key type.
+template<typename T>
+concept memo_key = utils::arithmetic<T> && sizeof(T) <= sizeof(std::uint64_t);
+
+// Table of one thread, see memo_cache and concurrent_memo_cache.
+template<memo_key T>
+class memo_table {
+public:
+    static constexpr std::size_t max_probes = 8;
+
+    // capacity is rounded up to a power of two
+    memo_table(std::size_t capacity, std::size_t width)
+        : _mask(std::bit_ceil(std::max<std::size_t>(capacity, 1)) - 1), _width(width),
+          _hashes(_mask + 1, 0), _keys((_mask + 1) * width), _values(_mask + 1) {}
+
+    static std::uint64_t bits(const T& value) {
+        if constexpr (sizeof(T) == 1)
+            return std::bit_cast<std::uint8_t>(value);
+        else if constexpr (sizeof(T) == 2)
+            return std::bit_cast<std::uint16_t>(value);
+        else if constexpr (sizeof(T) == 4)
+            return std::bit_cast<std::uint32_t>(value);
+        else
+            return std::bit_cast<std::uint64_t>(value);
+    }
+
+    static std::uint64_t hash(const std::span<const T> input) {
+        std::uint64_t res = 0x9e3779b97f4a7c15ull;
+        for (const T& value : input) {
+            res = (res ^ bits(value)) * 0xff51afd7ed558ccdull;
+            res ^= res >> 32;
+        }
+        // 0 marks empty slot
+        return res == 0 ? 1 : res;
+    }
+
+    bool find(std::uint64_t h, const std::span<const T> input, T& value) const {
+        for (std::size_t probe = 0; probe < max_probes; ++probe) {
+            const std::size_t slot = (h + probe) & _mask;
+            if (_hashes[slot] == 0)
+                return false;
+            if (_hashes[slot] == h && same_key(_keys.data() + slot * _width, input)) {
+                value = _values[slot];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void insert(std::uint64_t h, const std::span<const T> input, T value) {
+        std::size_t slot = h & _mask;
+        for (std::size_t probe = 0; probe < max_probes; ++probe) {
+            const std::size_t candidate = (h + probe) & _mask;
+            if (_hashes[candidate] == 0 || _hashes[candidate] == h) {
+                slot = candidate;
+                break;
+            }
+        }
+        _hashes[slot] = h;
+        std::copy(input.begin(), input.end(), _keys.begin() + static_cast<std::ptrdiff_t>(slot * _width));
+        _values[slot] = value;
+    }
+
+    void clear() {
+        std::fill(_hashes.begin(), _hashes.end(), 0);
+    }
+
+    std::size_t capacity() const {
+        return _mask + 1;
+    }
+
+private:
+    static bool same_key(const T* key, const std::span<const T> input) {
+        for (std::size_t j = 0; j < input.size(); ++j)
+            if (bits(key[j]) != bits(input[j]))
+                return false;
+        return true;
+    }
+
+    std::size_t _mask;
+    std::size_t _width;
+    std::vector<std::uint64_t> _hashes;
+    std::vector<T> _keys;
+    std::vector<T> _values;
+};
+
+// Cache of one formula for one thread.
+template<memo_key T>
+class memo_cache {
+public:
+    explicit memo_cache(const MathParser& formula, std::size_t capacity = 4096, std::size_t min_cost = default_memo_min_cost)
+        : _program(formula.get_program()), _enabled(_program.estimated_cost() >= min_cost),
+          _table(_enabled ? capacity : 1, _program.variables_count()) {}
+
+    T operator()(const std::span<const T> input) {
+        if (input.size() != _program.variables_count()) [[unlikely]]
+            throw std::domain_error{"Wrong number of variables."};
+        if (!_enabled) {
+            ++_statistics.bypassed;
+            return _program.evaluate(input);
+        }
+        const std::uint64_t h = memo_table<T>::hash(input);
+        T value;
+        if (_table.find(h, input, value)) {
+            ++_statistics.hits;
+            return value;
+        }
+        ++_statistics.misses;
+        value = _program.evaluate(input);
+        _table.insert(h, input, value);
+        return value;
+    }
+
+    T operator()(const std::initializer_list<T>& input) {
+        return (*this)(std::span(input));
+    }
+
+    bool enabled() const {
+        return _enabled;
+    }
+    const memo_statistics& statistics() const {
+        return _statistics;
+    }
+    void clear() {
+        _table.clear();
+        _statistics = {};
+    }
+
+private:
+    program _program;
+    bool _enabled;
+    memo_table<T> _table;
+    memo_statistics _statistics{};
+};
+
+// Cache of one formula shared by threads. The table is split into shards with their own locks, a lock is held
+// only for lookup and insertion, never while the formula is evaluated.
+template<memo_key T>
+class concurrent_memo_cache {
+public:
+    static constexpr std::size_t shards = 16;
+
+    explicit concurrent_memo_cache(const MathParser& formula, std::size_t capacity = 1 << 16, std::size_t min_cost = default_memo_min_cost)
+        : _program(formula.get_program()), _enabled(_program.estimated_cost() >= min_cost), _shards(std::make_unique<shard[]>(shards)) {
+        for (std::size_t k = 0; k < shards; ++k)
+            _shards[k].table = std::make_unique<memo_table<T>>(_enabled ? std::max<std::size_t>(capacity / shards, 1) : 1, _program.variables_count());
+    }
+
+    T operator()(const std::span<const T> input) const {
+        if (input.size() != _program.variables_count()) [[unlikely]]
+            throw std::domain_error{"Wrong number of variables."};
+        if (!_enabled) {
+            _bypassed.fetch_add(1, std::memory_order_relaxed);
+            return _program.evaluate(input);
+        }
+        const std::uint64_t h = memo_table<T>::hash(input);
+        // high bits choose the shard, low bits the slot
+        shard& s = _shards[h >> 60 & (shards - 1)];
+        T value;
+        {
+            std::lock_guard lock(s.mutex);
+            if (s.table->find(h, input, value)) {
+                _hits.fetch_add(1, std::memory_order_relaxed);
+                return value;
+            }
+        }
+        _misses.fetch_add(1, std::memory_order_relaxed);
+        value = _program.evaluate(input);
+        std::lock_guard lock(s.mutex);
+        s.table->insert(h, input, value);
+        return value;
+    }
+
+    T operator()(const std::initializer_list<T>& input) const {
+        return (*this)(std::span(input));
+    }
+
+    bool enabled() const {
+        return _enabled;
+    }
+    memo_statistics statistics() const {
+        return {_hits.load(), _misses.load(), _bypassed.load()};
+    }
+
+private:
+    struct alignas(64) shard {
+        std::mutex mutex;
+        std::unique_ptr<memo_table<T>> table;
+    };
+
+    program _program;
+    bool _enabled;
+    std::unique_ptr<shard[]> _shards;
+    mutable std::atomic<std::size_t> _hits{0};
+    mutable std::atomic<std::size_t> _misses{0};
+    mutable std::atomic<std::size_t> _bypassed{0};
+};
+
+}
@@ -3,34 +3,56 @@
 #include <algorithm>
 #include <numeric>
 #include <unordered_set>
-#include <iostream>
 #include <ranges>
+#include <stack>
 
 namespace {
 const std::unordered_map<std::string, std::size_t>& get_operator_priority() {
     using namespace std::string_literals;
-    static const std::unordered_map<std::string, std::size_t> operator_priority{{"("s, 0}, {"+"s, 1}, {"-"s, 1}, {"*"s, 2},
-                                                                                {"/"s, 2}, {"^"s, 3}, {"~"s, 4}, {"sin"s, 4}, 
-                                                                                {"cos"s, 4}, {"tan"s, 4}, {"atan"s, 4}, {"exp"s, 4},
-                                                                                {"abs"s, 4}, {"sign"s, 4}, {"sqr"s, 4},  {"sqrt"s, 4},
-                                                                                {"log"s, 4}, {"tgamma"s, 4}, {"exp2"s, 4}, {"expm1"s, 4},
-                                                                                {"log10"s, 4}, {"log2"s, 4}, {"log1p"s, 4}, {"cbrt"s, 4},
-                                                                                {"asin"s, 4}, {"acos"s, 4}, {"sinh"s, 4}, {"cosh"s, 4},
-                                                                                {"tanh"s, 4}, {"asinh"s, 4}, {"acosh"s, 4}, {"atanh"s, 4},
-                                                                                {"erf"s, 4}, {"erfc"s, 4}, {"lgamma"s, 4}, {"ceil"s, 4},
-                                                                                {"floor"s, 4}, {"round"s, 4}, {"trunc"s, 4}};
+    static const std::unordered_map<std::string, std::size_t> operator_priority{{"("s, 0}, {"<"s, 1}, {"<="s, 1}, {">"s, 1},
+                                                                                {">="s, 1}, {"=="s, 1}, {"!="s, 1}, {"+"s, 2},
+                                                                                {"-"s, 2}, {"*"s, 3}, {"/"s, 3}, {"^"s, 4},
+                                                                                {"~"s, 5}, {"sin"s, 5}, {"cos"s, 5}, {"tan"s, 5},
+                                                                                {"atan"s, 5}, {"exp"s, 5}, {"abs"s, 5}, {"sign"s, 5},
+                                                                                {"sqr"s, 5},  {"sqrt"s, 5}, {"log"s, 5}, {"tgamma"s, 5},
+                                                                                {"exp2"s, 5}, {"expm1"s, 5}, {"log10"s, 5}, {"log2"s, 5},
+                                                                                {"log1p"s, 5}, {"cbrt"s, 5}, {"asin"s, 5}, {"acos"s, 5},
+                                                                                {"sinh"s, 5}, {"cosh"s, 5}, {"tanh"s, 5}, {"asinh"s, 5},
+                                                                                {"acosh"s, 5}, {"atanh"s, 5}, {"erf"s, 5}, {"erfc"s, 5},
+                                                                                {"lgamma"s, 5}, {"ceil"s, 5}, {"floor"s, 5}, {"round"s, 5},
+                                                                                {"trunc"s, 5}, {"if"s, 5}, {"min"s, 5}, {"max"s, 5},
+                                                                                {"clamp"s, 5}, {"fma"s, 5}, {"hypot"s, 5}, {"atan2"s, 5},
+                                                                                {"pow"s, 5}};
     return operator_priority;
 }
 
 const std::unordered_set<char>& get_one_sym_operators() {
-    static const std::unordered_set<char> one_sym_operators {'(', ')', '+', '-', '*', '/', '~', '^'};
+    static const std::unordered_set<char> one_sym_operators {'(', ')', '+', '-', '*', '/', '~', '^', ',', '<', '>', '=', '!'};
     return one_sym_operators;
 }
 
-void check_variables_admissibility(const std::unordered_map<std::string, std::size_t>& variables) {
+// Functions of several arguments, the others take exactly one argument.
+const std::unordered_map<std::string, std::size_t>& get_functions_arity() {
+    using namespace std::string_literals;
+    static const std::unordered_map<std::string, std::size_t> functions_arity{{"if"s, 3}, {"min"s, 2}, {"max"s, 2}, {"clamp"s, 3},
+                                                                                 {"fma"s, 3}, {"hypot"s, 2}, {"atan2"s, 2}, {"pow"s, 2}};
+    return functions_arity;
+}
+
+bool is_function(const std::string& op) {
+    return !op.empty() && std::isalpha(op.front());
+}
+
+std::size_t function_arity(const std::string& function) {
+    const auto& functions_arity = get_functions_arity();
+    const auto it = functions_arity.find(function);
+    return it == functions_arity.end() ? 1 : it->second;
+}
+
+void check_variables_admissibility(const std::unordered_map<std::string, std::size_t>& variables, const parser::function_library* functions) {
     const auto& operator_priority = get_operator_priority();
     for (const auto& [variable, _] : variables) 
-        if (operator_priority.contains(variable))
+        if (operator_priority.contains(variable) || (functions != nullptr && functions->contains(variable)))
             throw std::domain_error{"Invalid variable designation. Variable name <" + variable + "> \
                                         is unavailable."};   
 }
@@ -78,19 +100,25 @@ std::unordered_map<std::string, std::size_t> get_variables(std::string pre_varia
 
 namespace parser {
 
-MathParser::MathParser(std::string pre_infix_notation) {
+MathParser::MathParser(std::string pre_infix_notation) : MathParser(std::move(pre_infix_notation), nullptr) {}
+
+MathParser::MathParser(std::string pre_infix_notation, const function_library& functions)
+    : MathParser(std::move(pre_infix_notation), &functions) {}
+
+MathParser::MathParser(std::string pre_infix_notation, const function_library* functions) {
     const std::size_t delimiter = pre_infix_notation.find(':');
     if (delimiter == std::string::npos)
         throw std::domain_error{"Wrong variables format. Symbol ':' is required after variables initialization."};
     _variables = ::get_variables(utils::trim(pre_infix_notation.substr(0, delimiter)));
-    check_variables_admissibility(_variables);
+    check_variables_admissibility(_variables, functions);
     std::string infix_notation = pre_infix_notation.substr(delimiter + 1);
     infix_notation = utils::delete_all(infix_notation, ' ');
     if (infix_notation.empty())
         throw std::domain_error{"Wrong expression format. Formula after ':' is required."};
     parentheses_check(infix_notation);
     dots_check(infix_notation);
-    assemble_polish_notation(infix_notation);
+    assemble_polish_notation(infix_notation, functions);
+    _program = program(optimize(build_tree(_polish_notation, _variables, functions)), _variables.size());
 }
 
 std::string MathParser::to_polish() const {
@@ -106,26 +134,32 @@ std::unordered_map<std::string,std::size_t> MathParser::get_variables() const {
     return _variables;
 }
 
-const std::unordered_map<std::string, MathParser::operator_index>& MathParser::get_arithmetic_operators() {
-    using namespace std::string_literals;
-    static const std::unordered_map<std::string, operator_index>
-        arithmetic_operators{  {"+"s,     operator_index::plus},   {"-"s,      operator_index::minus},  {"*"s,      operator_index::multiply},
-                               {"/"s,     operator_index::divide}, {"^"s,      operator_index::power},  {"~"s,      operator_index::unary_minus}, 
-                               {"sin"s,   operator_index::sin},    {"cos"s,    operator_index::cos},    {"tan"s,    operator_index::tan},  
-                               {"atan"s,  operator_index::atan},   {"exp"s,    operator_index::exp},    {"abs"s,    operator_index::abs},   
-                               {"sign"s,  operator_index::sign},   {"sqr"s,    operator_index::sqr},    {"sqrt"s,   operator_index::sqrt},
-                               {"log"s,   operator_index::log},    {"tgamma"s, operator_index::tgamma}, {"exp2"s,   operator_index::exp2},
-                               {"expm1"s, operator_index::expm1},  {"log10"s,  operator_index::log10},  {"log2"s,   operator_index::log2},
-                               {"log1p"s, operator_index::log1p},  {"cbrt"s,   operator_index::cbrt},   {"asin"s,   operator_index::asin},
-                               {"acos"s,  operator_index::acos},   {"sinh"s,   operator_index::sinh},   {"cosh"s,   operator_index::cosh},
-                               {"tanh"s,  operator_index::tanh},   {"asinh"s,  operator_index::asinh},  {"acosh"s,  operator_index::acosh},
-                               {"atanh"s, operator_index::atanh},  {"erf"s,    operator_index::erf},    {"lgamma"s, operator_index::lgamma},
-                               {"erfc"s,  operator_index::erfc},   {"ceil"s,   operator_index::ceil},   {"trunc"s,  operator_index::trunc},
-                               {"floor"s, operator_index::floor},  {"round"s,  operator_index::round}};
-    return arithmetic_operators;
-}
-
-std::unordered_map<std::size_t, std::string> MathParser::find_variables_and_operators(const std::string& infix_notation) const {
+const std::vector<std::string>& MathParser::warnings() const {
+    return _warnings;
+}
+
+const program& MathParser::get_program() const {
+    return _program;
+}
+
+std::size_t MathParser::memory_footprint() const {
+    // node of unordered_map keeps the next pointer, the value and the cached hash
+    static constexpr std::size_t variable_node_size = sizeof(void*) + sizeof(std::pair<const std::string, std::size_t>) + sizeof(std::size_t);
+    std::size_t res = sizeof(MathParser) + _program.memory_footprint() - sizeof(program);
+    res += _polish_notation.capacity() * sizeof(std::string);
+    for (const std::string& token : _polish_notation)
+        res += utils::heap_size(token);
+    res += _variables.bucket_count() * sizeof(void*) + _variables.size() * variable_node_size;
+    for (const auto& [variable, _] : _variables)
+        res += utils::heap_size(variable);
+    res += _warnings.capacity() * sizeof(std::string);
+    for (const std::string& warning : _warnings)
+        res += utils::heap_size(warning);
+    return res;
+}
+
+std::unordered_map<std::size_t, std::string> MathParser::find_variables_and_operators(const std::string& infix_notation,
+                                                                                      const function_library* functions) {
     const auto& operator_priority = get_operator_priority();
     const auto& one_symbol_operator = get_one_sym_operators();
     std::unordered_map<std::size_t, std::string> variables_and_operators_indices;
@@ -152,32 +186,66 @@ std::unordered_map<std::size_t, std::string> MathParser::find_variables_and_oper
         if (!one_symbol_operator.contains(op.front()))
             push_it(op);
 
+    if (functions != nullptr)
+        for (const std::string& function : functions->names())
+            push_it(function);
+
     if (variables_and_operators_indices.empty()) 
-        std::cout << "Warning: expression does not depend on the variables." << std::endl;
+        _warnings.emplace_back("Expression does not depend on the variables.");
     return variables_and_operators_indices;
 }
 
-void MathParser::assemble_polish_notation(const std::string& infix_notation) {
-    const auto variables_and_operators_indices = find_variables_and_operators(infix_notation);
+void MathParser::assemble_polish_notation(const std::string& infix_notation, const function_library* functions) {
+    const auto variables_and_operators_indices = find_variables_and_operators(infix_notation, functions);
     const auto& operator_priority = get_operator_priority();
+    // user functions have the priority of built-in ones
+    const auto priority = [&operator_priority](const std::string& op) {
+        const auto it = operator_priority.find(op);
+        return it == operator_priority.end() ? operator_priority.at("sin") : it->second;
+    };
+    const auto is_user_function = [functions](const std::string& op) {
+        return functions != nullptr && functions->contains(op);
+    };
+    const auto arity = [functions](const std::string& function) {
+        const auto user = functions != nullptr ? functions->find(function) : nullptr;
+        return user ? user->arity : function_arity(function);
+    };
     const auto& one_symbol_operator = get_one_sym_operators();
     std::stack<std::string> operators;
+    // number of arguments met inside every open parenthesis
+    std::stack<std::size_t> arguments;
+    const auto push_operator = [this, &operators, &priority](const std::string& op) {
+        while (!operators.empty() && (priority(operators.top()) >= priority(op))) {
+            _polish_notation.push_back(operators.top());
+            operators.pop();
+        }
+        operators.push(op);
+    };
+    const auto pop_until_parenthesis = [this, &operators]() {
+        while (!operators.empty() && operators.top() != std::string{ '(' }) {
+            _polish_notation.push_back(operators.top());
+            operators.pop();
+        }
+    };
     for (std::size_t i = 0; i < infix_notation.size(); ++i) {
         const char symbol = infix_notation[i];
         if (variables_and_operators_indices.contains(i)) {
             const auto& smth = variables_and_operators_indices.at(i);
-            if (operator_priority.contains(smth)) {
-                while (!operators.empty() && (operator_priority.at(operators.top()) >= operator_priority.at(smth))) {
-                    _polish_notation.push_back(operators.top());
-                    operators.pop();
-                }
-                operators.push(smth);
+            if (operator_priority.contains(smth) || is_user_function(smth)) {
+                push_operator(smth);
             } else if (_variables.contains(smth)) {
                 _polish_notation.push_back(smth);
             } else {
                 throw std::domain_error{"Wrong variables and operators searching. Can not find contained string."};
             }
             i += smth.size() - 1;
+        } else if (std::isalpha(symbol)) {
+            // the call of unknown function would be dropped and leave its argument in place
+            std::size_t end = i;
+            while (end < infix_notation.size() && std::isalnum(infix_notation[end]))
+                ++end;
+            if (end < infix_notation.size() && infix_notation[end] == '(')
+                throw std::domain_error{"Wrong expression format. Unknown function <" + infix_notation.substr(i, end - i) + ">."};
         } else if (std::isdigit(symbol) || symbol == '.') {
             if (i == 0 || (i > 0 && !std::isdigit(infix_notation[i - 1]) && infix_notation[i - 1] != '.')) {
                 _polish_notation.emplace_back(std::string{ symbol });
@@ -186,23 +254,34 @@ void MathParser::assemble_polish_notation(const std::string& infix_notation) {
             }
         } else if (symbol == '(') {
             operators.push(std::string{ symbol });
+            arguments.push(1);
+        } else if (symbol == ',') {
+            if (arguments.empty())
+                throw std::domain_error{"Wrong expression format. Arguments separator ',' is only allowed inside function call."};
+            pop_until_parenthesis();
+            ++arguments.top();
         } else if (symbol == ')') {
-            while (!operators.empty() && operators.top() != std::string{ '(' }) {
-                _polish_notation.push_back(operators.top());
-                operators.pop();
-            }
+            if (arguments.empty())
+                throw std::domain_error{"Wrong expression format. The expression contains unopened parentheses."};
+            pop_until_parenthesis();
             operators.pop();
-        } else if (one_symbol_operator.contains(symbol) && operator_priority.contains(std::string{symbol})) {
+            const std::size_t arguments_count = arguments.top();
+            arguments.pop();
+            const bool is_call = !operators.empty() && is_function(operators.top());
+            if (arguments_count != (is_call ? arity(operators.top()) : 1))
+                throw std::domain_error{"Wrong expression format. Wrong number of arguments" + 
+                                        (is_call ? " in call of <" + operators.top() + ">." : " inside parentheses.")};
+        } else if (one_symbol_operator.contains(symbol)) {
             std::string op = std::string{ symbol };
+            // for two symbols comparisons
+            if (i + 1 < infix_notation.size() && infix_notation[i + 1] == '=' && (symbol == '<' || symbol == '>' || symbol == '=' || symbol == '!'))
+                op.push_back(infix_notation[++i]);
             // for unary minus
-            if (op == std::string{ '-' } && (i == 0 || (i > 1 && operator_priority.contains(std::string{ infix_notation[i - 1] }) )))
+            if (op == std::string{ '-' } && (i == 0 || (one_symbol_operator.contains(infix_notation[i - 1]) && infix_notation[i - 1] != ')')))
                 op = std::string{ '~' };
-
-            while (!operators.empty() && (operator_priority.at(operators.top()) >= operator_priority.at(op))) {
-                _polish_notation.push_back(operators.top());
-                operators.pop();
-            }
-            operators.push(op);
+            if (!operator_priority.contains(op))
+                throw std::domain_error{"Wrong expression format. Unknown operator <" + op + ">."};
+            push_operator(op);
         }
     }
     while (!operators.empty()) {
@@ -2,9 +2,11 @@
 
 #include "utils.hpp"
 #include "expression.hpp"
+#include "program.hpp"
+#include "batch.hpp"
+#include "functions.hpp"
 
 #include <unordered_map>
-#include <stack>
 #include <span>
 #include <stdexcept>
 
@@ -15,10 +17,18 @@ namespace parser {
 class MathParser {
 public:
     explicit MathParser(std::string pre_infix_notation);
+    // Formula may call functions of the library, they are inlined during compilation.
+    MathParser(std::string pre_infix_notation, const function_library& functions);
 
     std::string to_polish() const;
     std::size_t variables_count() const;
     std::unordered_map<std::string, std::size_t> get_variables() const;
+    // Problems which do not prevent evaluation, e.g. expression which does not depend on variables.
+    const std::vector<std::string>& warnings() const;
+    // Optimized tape which is used for evaluation, polish notation is kept as it was parsed.
+    const program& get_program() const;
+    // Approximate bytes owned by the parser including heap storage of tokens, variables and program.
+    std::size_t memory_footprint() const;
 
     template <utils::arithmetic T>
     T operator()(const std::span<const T> input_vars) const {
@@ -30,137 +40,73 @@ public:
         return this->operator()(std::span(input_vars));
     }
 
+    // Evaluates formula on the grid: axes[j] holds values of variable with index j, see get_variables().
+    // Output is row-major with the last axis changing fastest, subexpressions of outer variables are hoisted
+    // out of inner loops.
+    template <utils::arithmetic T>
+    void evaluate_grid(const std::span<const std::span<const T>> axes, const std::span<T> out) const {
+        if (axes.size() != _variables.size()) [[unlikely]]
+            throw std::domain_error{"Wrong number of axes."};
+        std::size_t points = 1;
+        for (const auto& axis : axes)
+            points *= axis.size();
+        if (out.size() != points) [[unlikely]]
+            throw std::domain_error{"Wrong output size. Output must contain value for every point of the grid."};
+        if (points > 0)
+            _program.evaluate_grid(axes, out);
+    }
+
+    // Batch evaluation over columns: columns[j][i] is value of variable with index j in row i.
+    // threads = 0 uses all hardware threads.
+    template <utils::arithmetic T>
+    void evaluate_batch(const std::span<const std::span<const T>> columns, const std::span<T> out, std::size_t threads = 1) const {
+        check_columns(columns, out.size());
+        parser::evaluate_batch(_program, columns, out, threads);
+    }
+
+    // Sum, mean, min and max of formula over rows without materializing values. Sum is pairwise and
+    // does not depend on number of threads.
+    template <utils::arithmetic T>
+    batch_statistics<T> reduce_batch(const std::span<const std::span<const T>> columns, std::size_t rows, std::size_t threads = 1) const {
+        check_columns(columns, rows);
+        return parser::reduce_batch(_program, columns, rows, threads);
+    }
+
+    template <utils::arithmetic T>
+    histogram histogram_batch(const std::span<const std::span<const T>> columns, std::size_t rows,
+                              T lower, T upper, std::size_t bins, std::size_t threads = 1) const {
+        check_columns(columns, rows);
+        return parser::histogram_batch(_program, columns, rows, lower, upper, bins, threads);
+    }
+
 private:
-    enum class operator_index : std::size_t {
-        plus, minus, unary_minus,
-        multiply, divide, power, sqr, sqrt, cbrt,
-        sin, asin, sinh, asinh, cos, acos, cosh, acosh, tan, atan, tanh, atanh,
-        exp, exp2, expm1, log, log10, log2, log1p,
-        abs, sign, ceil, floor, trunc, round,
-        tgamma, lgamma, erf, erfc
-    };
-
-    template<utils::arithmetic T>
-    T execute(const std::unordered_map<std::string, MathParser::operator_index>& ops, 
-              std::stack<T>& calculation_values, const std::string& op) const {
-        const auto pop_element = [&calculation_values]() {
-            T elem = T(0);
-            if (!calculation_values.empty()) {
-                elem = calculation_values.top();
-                calculation_values.pop();
-            }
-            return elem;
-        };
-        const T right = pop_element();
-        switch(ops.at(op))
-        {
-        case operator_index::plus:
-            return pop_element() + right;
-        case operator_index::minus:
-            return pop_element() - right;
-        case operator_index::multiply:
-            return pop_element() * right;
-        case operator_index::divide:
-            return pop_element() / right;
-        case operator_index::power:
-            return std::pow(pop_element(), right);
-        case operator_index::unary_minus:
-            return -right;
-        case operator_index::sin:
-            return std::sin(right);
-        case operator_index::cos:
-            return std::cos(right);
-        case operator_index::tan:
-            return std::tan(right);
-        case operator_index::atan:
-            return std::atan(right);
-        case operator_index::exp:
-            return std::exp(right);
-        case operator_index::abs:
-            return std::abs(right);
-        case operator_index::sign:
-            return (right > 0) - (right < 0);
-        case operator_index::sqr:
-            return right * right;
-        case operator_index::sqrt:
-            return std::sqrt(right);
-        case operator_index::log:
-            return std::log(right);
-        case operator_index::tgamma:
-            return std::tgamma(right);
-        case operator_index::lgamma:
-            return std::lgamma(right);
-        case operator_index::exp2:
-            return std::exp2(right);
-        case operator_index::expm1:
-            return std::expm1(right);
-        case operator_index::log10:
-            return std::log10(right);
-        case operator_index::log2:
-            return std::log2(right);
-        case operator_index::log1p:
-            return std::log1p(right);
-        case operator_index::cbrt:
-            return std::cbrt(right);
-        case operator_index::asin:
-            return std::asin(right);
-        case operator_index::acos:
-            return std::acos(right);
-        case operator_index::sinh:
-            return std::sinh(right);
-        case operator_index::cosh:
-            return std::cosh(right);
-        case operator_index::tanh:
-            return std::tanh(right);
-        case operator_index::asinh:
-            return std::asinh(right);
-        case operator_index::acosh:
-            return std::acosh(right);
-        case operator_index::atanh:
-            return std::atanh(right);
-        case operator_index::erf:
-            return std::erf(right);
-        case operator_index::erfc:
-            return std::erfc(right);
-        case operator_index::ceil:
-            return std::ceil(right);
-        case operator_index::floor:
-            return std::floor(right);
-        case operator_index::trunc:
-            return std::trunc(right);
-        case operator_index::round:
-            return std::round(right);
-        default:
-            throw std::domain_error{"Error. Undefined operator <" + op + ">/."};
-        }
+    template <utils::arithmetic T>
+    void check_columns(const std::span<const std::span<const T>> columns, std::size_t rows) const {
+        if (columns.size() != _variables.size()) [[unlikely]]
+            throw std::domain_error{"Wrong number of columns."};
+        for (const auto& column : columns)
+            if (column.size() < rows) [[unlikely]]
+                throw std::domain_error{"Wrong number of rows. Every column must contain at least as many values as output."};
     }
 
     template <utils::arithmetic T>
     T calc_polish_notation(const std::span<const T> input_variables) const {
         if (input_variables.size() != _variables.size()) [[unlikely]]
             throw std::domain_error{"Wrong number of variables."};
-        const auto& arithmetic_operators = get_arithmetic_operators();
-        std::stack<T> calculation_values;
-        for (const std::string& smth : _polish_notation) {
-            if (utils::is_number(smth)) {
-                calculation_values.push(utils::get_number<T>(smth));
-            }
-            else if (_variables.count(smth) > 0) {
-                calculation_values.push(input_variables[_variables.at(smth)]);
-            }
-            else if (arithmetic_operators.count(smth) > 0) {
-                calculation_values.push(execute<T>(arithmetic_operators, calculation_values, smth));
-            }
-        }
-        return calculation_values.top();
+        return _program.evaluate(input_variables);
     }
 
-    static const std::unordered_map<std::string, operator_index>& get_arithmetic_operators();
-    std::unordered_map<std::size_t, std::string> find_variables_and_operators(const std::string& infix_notation) const;
-    void assemble_polish_notation(const std::string& infix_notation);
+    friend class function_library;
+
+    MathParser(std::string pre_infix_notation, const function_library* functions);
+
+    std::unordered_map<std::size_t, std::string> find_variables_and_operators(const std::string& infix_notation, const function_library* functions);
+    void assemble_polish_notation(const std::string& infix_notation, const function_library* functions);
 
     std::vector<std::string> _polish_notation{};
     std::unordered_map<std::string, std::size_t> _variables;
+    program _program{};
+    std::vector<std::string> _warnings{};
 };
 
 };
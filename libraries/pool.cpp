@@ -0,0 +1,83 @@
+#include "pool.hpp"
+
+#include <limits>
+
+namespace parser {
+
+formula_pool::formula_id formula_pool::add(const MathParser& formula) {
+    const program& compiled = formula.get_program();
+    const auto variables = formula.get_variables();
+    // offsets, counts and interned names are stored as uint32_t, every new name may be interned
+    constexpr std::size_t limit = std::numeric_limits<std::uint32_t>::max();
+    if (_formulas.size() >= std::numeric_limits<formula_id>::max() || _code.size() + compiled.size() >= limit ||
+        _constants.size() + compiled.constants().size() >= limit || _variables.size() + variables.size() >= limit ||
+        _names.size() + variables.size() >= limit)
+        throw std::domain_error{"Formula pool is full."};
+
+    const auto to_index = [](std::size_t value) { return static_cast<std::uint32_t>(value); };
+    _formulas.push_back({to_index(_code.size()), to_index(compiled.size()), to_index(_constants.size()),
+                         to_index(_variables.size()), to_index(compiled.variables_count())});
+    _code.insert(_code.end(), compiled.code().begin(), compiled.code().end());
+    _constants.insert(_constants.end(), compiled.constants().begin(), compiled.constants().end());
+
+    _variables.resize(_variables.size() + variables.size());
+    for (const auto& [name, index] : variables)
+        _variables[_formulas.back().names_offset + index] = intern(name);
+    return static_cast<formula_id>(_formulas.size() - 1);
+}
+
+formula_pool::formula_id formula_pool::add(std::string pre_infix_notation) {
+    return add(MathParser(std::move(pre_infix_notation)));
+}
+
+std::size_t formula_pool::size() const {
+    return _formulas.size();
+}
+
+std::size_t formula_pool::variables_count(formula_id id) const {
+    return _formulas.at(id).variables_count;
+}
+
+std::vector<std::string_view> formula_pool::get_variables(formula_id id) const {
+    const formula& f = _formulas.at(id);
+    std::vector<std::string_view> res;
+    res.reserve(f.variables_count);
+    for (std::uint32_t i = 0; i < f.variables_count; ++i)
+        res.emplace_back(*_names[_variables[f.names_offset + i]]);
+    return res;
+}
+
+std::size_t formula_pool::interned_names_count() const {
+    return _names.size();
+}
+
+std::size_t formula_pool::memory_footprint() const {
+    static constexpr std::size_t name_node_size = sizeof(void*) + sizeof(std::pair<const std::string, std::uint32_t>) + sizeof(std::size_t);
+    std::size_t res = sizeof(formula_pool);
+    res += _formulas.capacity() * sizeof(formula);
+    res += _code.capacity() * sizeof(instruction);
+    res += _constants.capacity() * sizeof(double);
+    res += _variables.capacity() * sizeof(std::uint32_t);
+    res += _names.capacity() * sizeof(const std::string*);
+    res += _interned.bucket_count() * sizeof(void*) + _interned.size() * name_node_size;
+    for (const auto& [name, _] : _interned)
+        res += utils::heap_size(name);
+    return res;
+}
+
+void formula_pool::shrink_to_fit() {
+    _formulas.shrink_to_fit();
+    _code.shrink_to_fit();
+    _constants.shrink_to_fit();
+    _variables.shrink_to_fit();
+    _names.shrink_to_fit();
+}
+
+std::uint32_t formula_pool::intern(const std::string& name) {
+    const auto [it, inserted] = _interned.try_emplace(name, static_cast<std::uint32_t>(_names.size()));
+    if (inserted)
+        _names.push_back(&it->first);
+    return it->second;
+}
+
+}
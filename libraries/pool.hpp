@@ -0,0 +1,67 @@
+#pragma once
+
+#include "parser.hpp"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Storage for large number of compiled formulas. Instructions and constants of all formulas live in shared
+// contiguous arrays, variable names are interned, a formula itself is a few offsets into them.
+// Tokens of polish notation are not kept.
+namespace parser {
+
+class formula_pool {
+public:
+    using formula_id = std::uint32_t;
+
+    formula_id add(const MathParser& formula);
+    formula_id add(std::string pre_infix_notation);
+
+    template <utils::arithmetic T>
+    T evaluate(formula_id id, const std::span<const T> input_vars) const {
+        const formula& f = _formulas.at(id);
+        if (input_vars.size() != f.variables_count) [[unlikely]]
+            throw std::domain_error{"Wrong number of variables."};
+        return parser::evaluate(std::span<const instruction>(_code.data() + f.code_offset, f.code_size),
+                                _constants.data() + f.constants_offset, input_vars);
+    }
+
+    template <utils::arithmetic T>
+    T evaluate(formula_id id, const std::initializer_list<T>& input_vars) const {
+        return evaluate(id, std::span(input_vars));
+    }
+
+    std::size_t size() const;
+    std::size_t variables_count(formula_id id) const;
+    // Names of variables in the order of input.
+    std::vector<std::string_view> get_variables(formula_id id) const;
+    std::size_t interned_names_count() const;
+    // Approximate bytes owned by the pool including heap storage.
+    std::size_t memory_footprint() const;
+    void shrink_to_fit();
+
+private:
+    struct formula {
+        std::uint32_t code_offset;
+        std::uint32_t code_size;
+        std::uint32_t constants_offset;
+        std::uint32_t names_offset;
+        std::uint32_t variables_count;
+    };
+
+    std::uint32_t intern(const std::string& name);
+
+    std::vector<formula> _formulas{};
+    std::vector<instruction> _code{};
+    std::vector<double> _constants{};
+    // interned name of every variable of every formula
+    std::vector<std::uint32_t> _variables{};
+    std::unordered_map<std::string, std::uint32_t> _interned{};
+    // names by interned index, point to keys of _interned
+    std::vector<const std::string*> _names{};
+};
+
+}
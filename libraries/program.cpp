@@ -0,0 +1,514 @@
+#include "program.hpp"
+#include "functions.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+#include <map>
+#include <optional>
+#include <stack>
+#include <stdexcept>
+
+namespace {
+using parser::node;
+using parser::operator_index;
+
+constexpr std::int64_t max_integer_exponent = 64;
+constexpr std::size_t max_polynomial_degree = 64;
+
+node make_node(operator_index op, std::vector<node> args) {
+    node res;
+    res.op = op;
+    res.args = std::move(args);
+    return res;
+}
+
+bool is_constant(const node& tree) {
+    return tree.op == operator_index::constant;
+}
+
+bool is_integer_constant(const node& tree) {
+    return is_constant(tree) && std::trunc(tree.value) == tree.value && std::abs(tree.value) <= max_integer_exponent;
+}
+
+bool equal_trees(const node& a, const node& b) {
+    if (a.op != b.op || a.args.size() != b.args.size())
+        return false;
+    if (a.op == operator_index::constant)
+        return std::bit_cast<std::uint64_t>(a.value) == std::bit_cast<std::uint64_t>(b.value);
+    if (a.op == operator_index::variable || a.op == operator_index::powi) {
+        if (a.index != b.index)
+            return false;
+    }
+    if (a.op == operator_index::polynomial && a.coefficients != b.coefficients)
+        return false;
+    if (a.op == operator_index::argument)
+        return a.shared == b.shared;
+    for (std::size_t i = 0; i < a.args.size(); ++i)
+        if (!equal_trees(a.args[i], b.args[i]))
+            return false;
+    return true;
+}
+
+using coefficients_t = std::vector<double>;
+
+bool is_integer(double value) {
+    return std::trunc(value) == value;
+}
+
+// Coefficients are combined only if the result does not change for integer formulas, where every constant
+// is truncated: one of them is neutral (0 for sums, 1 for products) or both are integers.
+bool exact_combination(double a, double b, double neutral) {
+    return a == neutral || b == neutral || (is_integer(a) && is_integer(b));
+}
+
+std::optional<coefficients_t> add(coefficients_t a, const coefficients_t& b, double sign) {
+    a.resize(std::max(a.size(), b.size()), 0.);
+    for (std::size_t i = 0; i < b.size(); ++i) {
+        if (!exact_combination(a[i], b[i], 0.))
+            return std::nullopt;
+        a[i] += sign * b[i];
+    }
+    return a;
+}
+
+// Degree of monomial c * x^k, nullopt for polynomials with several terms.
+std::optional<std::size_t> monomial_degree(const coefficients_t& a) {
+    std::optional<std::size_t> degree;
+    for (std::size_t k = 0; k < a.size(); ++k)
+        if (a[k] != 0.) {
+            if (degree)
+                return std::nullopt;
+            degree = k;
+        }
+    return degree ? degree : std::size_t(0);
+}
+
+std::optional<coefficients_t> multiply_monomials(const coefficients_t& a, const coefficients_t& b) {
+    const auto i = monomial_degree(a), j = monomial_degree(b);
+    if (!i || !j || *i + *j > max_polynomial_degree || !exact_combination(a[*i], b[*j], 1.))
+        return std::nullopt;
+    coefficients_t res(*i + *j + 1, 0.);
+    res[*i + *j] = a[*i] * b[*j];
+    return res;
+}
+
+// Collects coefficients of a sum of monomials c * x^k of the only variable x with constant c. Products and powers
+// of sums are not expanded: (x - 1)^10 near its root loses all digits in the monomial form. Division is not
+// accepted, integer formulas would change their results.
+std::optional<coefficients_t> as_polynomial(const node& tree, std::int64_t& x) {
+    const auto both = [&tree, &x]() -> std::optional<std::pair<coefficients_t, coefficients_t>> {
+        auto a = as_polynomial(tree.args[0], x);
+        if (!a)
+            return std::nullopt;
+        auto b = as_polynomial(tree.args[1], x);
+        if (!b)
+            return std::nullopt;
+        return std::make_pair(std::move(*a), std::move(*b));
+    };
+    const auto power = [&tree, &x](std::int64_t exponent) -> std::optional<coefficients_t> {
+        auto base = as_polynomial(tree.args[0], x);
+        if (!base || exponent < 0)
+            return std::nullopt;
+        std::optional<coefficients_t> res = coefficients_t{1.};
+        for (std::int64_t i = 0; i < exponent && res; ++i)
+            res = multiply_monomials(*res, *base);
+        return res;
+    };
+    switch (tree.op) {
+    case operator_index::constant:
+        return coefficients_t{tree.value};
+    case operator_index::variable:
+        if (x >= 0 && x != tree.index)
+            return std::nullopt;
+        x = tree.index;
+        return coefficients_t{0., 1.};
+    case operator_index::unary_minus: {
+        auto a = as_polynomial(tree.args[0], x);
+        if (a)
+            for (double& c : *a)
+                c = -c;
+        return a;
+    }
+    case operator_index::plus:
+    case operator_index::minus: {
+        const auto terms = both();
+        if (!terms)
+            return std::nullopt;
+        return add(terms->first, terms->second, tree.op == operator_index::plus ? 1. : -1.);
+    }
+    case operator_index::multiply: {
+        const auto factors = both();
+        if (!factors)
+            return std::nullopt;
+        return multiply_monomials(factors->first, factors->second);
+    }
+    case operator_index::fma: {
+        const auto factors = both();
+        auto term = factors ? as_polynomial(tree.args[2], x) : std::nullopt;
+        if (!term)
+            return std::nullopt;
+        const auto product = multiply_monomials(factors->first, factors->second);
+        return product ? add(*product, *term, 1.) : std::nullopt;
+    }
+    case operator_index::sqr:
+        return power(2);
+    case operator_index::powi:
+        return power(tree.index);
+    case operator_index::power:
+        if (!is_integer_constant(tree.args[1]))
+            return std::nullopt;
+        return power(static_cast<std::int64_t>(tree.args[1].value));
+    default:
+        return std::nullopt;
+    }
+}
+
+// Polynomial is worth rewriting if it is not a monomial and has at least second degree.
+std::optional<node> make_polynomial(const node& tree) {
+    std::int64_t x = -1;
+    auto coefficients = as_polynomial(tree, x);
+    if (!coefficients || x < 0)
+        return std::nullopt;
+    while (coefficients->size() > 1 && coefficients->back() == 0.)
+        coefficients->pop_back();
+    const auto terms = std::ranges::count_if(*coefficients, [](double c) { return c != 0.; });
+    if (coefficients->size() < 3 || terms < 2)
+        return std::nullopt;
+    node variable;
+    variable.op = operator_index::variable;
+    variable.index = x;
+    node res = make_node(operator_index::polynomial, {std::move(variable)});
+    res.coefficients = std::move(*coefficients);
+    return res;
+}
+
+// Computes operator with constant operands at compile time. Integer formulas truncate every constant and every
+// result, so only integers which give integer result are folded: 2 * 3 + 1 is 7, but 7 / 2 * 2 is kept.
+std::optional<node> fold_constants(const node& tree) {
+    static constexpr double max_folded = std::numeric_limits<std::int32_t>::max();
+    const auto foldable = [](double value) { return is_integer(value) && std::abs(value) <= max_folded; };
+    if (tree.args.empty() || tree.op == operator_index::polynomial)
+        return std::nullopt;
+    std::array<double, 3> values{};
+    for (std::size_t i = 0; i < tree.args.size(); ++i) {
+        if (!is_constant(tree.args[i]) || !foldable(tree.args[i].value))
+            return std::nullopt;
+        values[i] = tree.args[i].value;
+    }
+    node res;
+    res.value = tree.op == operator_index::powi ? parser::utils::powi(values[0], static_cast<std::int32_t>(tree.index))
+                                                : parser::apply<double>(tree.op, values[0], values[1], values[2]);
+    if (!foldable(res.value))
+        return std::nullopt;
+    return res;
+}
+
+// Returns base of squared expression: sqr(a), a^2 or a * a.
+const node* squared_base(const node& tree) {
+    switch (tree.op) {
+    case operator_index::sqr:
+        return &tree.args[0];
+    case operator_index::power:
+        return (is_constant(tree.args[1]) && tree.args[1].value == 2.) ? &tree.args[0] : nullptr;
+    case operator_index::powi:
+        return tree.index == 2 ? &tree.args[0] : nullptr;
+    case operator_index::multiply:
+        return equal_trees(tree.args[0], tree.args[1]) ? &tree.args[0] : nullptr;
+    default:
+        return nullptr;
+    }
+}
+
+struct emitter {
+    std::vector<parser::instruction>& code;
+    std::vector<double>& constants;
+    std::map<parser::instruction, std::uint32_t> instructions{};
+    std::map<std::uint64_t, std::uint32_t> constants_indices{};
+    std::map<const parser::shared_tree*, std::uint32_t> arguments{};
+
+    std::uint32_t push(const parser::instruction& ins) {
+        const auto [it, inserted] = instructions.try_emplace(ins, static_cast<std::uint32_t>(code.size()));
+        if (inserted)
+            code.push_back(ins);
+        return it->second;
+    }
+
+    std::uint32_t operator()(const node& tree) {
+        if (tree.op == operator_index::argument) {
+            if (const auto it = arguments.find(tree.shared.get()); it != arguments.end())
+                return it->second;
+            const std::uint32_t res = (*this)(tree.shared->tree);
+            arguments.emplace(tree.shared.get(), res);
+            return res;
+        }
+        parser::instruction ins{tree.op};
+        if (tree.op == operator_index::constant) {
+            const auto [it, inserted] = constants_indices.try_emplace(std::bit_cast<std::uint64_t>(tree.value),
+                                                                      static_cast<std::uint32_t>(constants.size()));
+            if (inserted)
+                constants.push_back(tree.value);
+            ins.args[0] = it->second;
+        } else if (tree.op == operator_index::variable) {
+            ins.args[0] = static_cast<std::uint32_t>(tree.index);
+        } else {
+            for (std::size_t i = 0; i < tree.args.size(); ++i)
+                ins.args[i] = (*this)(tree.args[i]);
+            if (tree.op == operator_index::powi)
+                ins.args[1] = static_cast<std::uint32_t>(static_cast<std::int32_t>(tree.index));
+            if (tree.op == operator_index::polynomial) {
+                ins.args[1] = static_cast<std::uint32_t>(constants.size());
+                ins.args[2] = static_cast<std::uint32_t>(tree.coefficients.size());
+                constants.insert(constants.end(), tree.coefficients.begin(), tree.coefficients.end());
+            }
+        }
+        return push(ins);
+    }
+};
+
+}
+
+namespace parser {
+
+const std::unordered_map<std::string, operator_index>& get_arithmetic_operators() {
+    using namespace std::string_literals;
+    static const std::unordered_map<std::string, operator_index>
+        arithmetic_operators{  {"+"s,     operator_index::plus},   {"-"s,      operator_index::minus},  {"*"s,      operator_index::multiply},
+                               {"/"s,     operator_index::divide}, {"^"s,      operator_index::power},  {"~"s,      operator_index::unary_minus},
+                               {"sin"s,   operator_index::sin},    {"cos"s,    operator_index::cos},    {"tan"s,    operator_index::tan},
+                               {"atan"s,  operator_index::atan},   {"exp"s,    operator_index::exp},    {"abs"s,    operator_index::abs},
+                               {"sign"s,  operator_index::sign},   {"sqr"s,    operator_index::sqr},    {"sqrt"s,   operator_index::sqrt},
+                               {"log"s,   operator_index::log},    {"tgamma"s, operator_index::tgamma}, {"exp2"s,   operator_index::exp2},
+                               {"expm1"s, operator_index::expm1},  {"log10"s,  operator_index::log10},  {"log2"s,   operator_index::log2},
+                               {"log1p"s, operator_index::log1p},  {"cbrt"s,   operator_index::cbrt},   {"asin"s,   operator_index::asin},
+                               {"acos"s,  operator_index::acos},   {"sinh"s,   operator_index::sinh},   {"cosh"s,   operator_index::cosh},
+                               {"tanh"s,  operator_index::tanh},   {"asinh"s,  operator_index::asinh},  {"acosh"s,  operator_index::acosh},
+                               {"atanh"s, operator_index::atanh},  {"erf"s,    operator_index::erf},    {"lgamma"s, operator_index::lgamma},
+                               {"erfc"s,  operator_index::erfc},   {"ceil"s,   operator_index::ceil},   {"trunc"s,  operator_index::trunc},
+                               {"floor"s, operator_index::floor},  {"round"s,  operator_index::round},  {"<"s,      operator_index::less},
+                               {"<="s,    operator_index::less_equal}, {">"s,  operator_index::greater}, {">="s,   operator_index::greater_equal},
+                               {"=="s,    operator_index::equal},  {"!="s,     operator_index::not_equal}, {"if"s,   operator_index::select},
+                               {"min"s,   operator_index::min},    {"max"s,    operator_index::max},    {"clamp"s,  operator_index::clamp},
+                               {"fma"s,   operator_index::fma},    {"hypot"s,  operator_index::hypot},  {"atan2"s,  operator_index::atan2},
+                               {"pow"s,   operator_index::power}};
+    return arithmetic_operators;
+}
+
+std::size_t arity(operator_index op) {
+    switch (op) {
+    case operator_index::constant:
+    case operator_index::variable:
+    case operator_index::argument:
+        return 0;
+    case operator_index::plus:
+    case operator_index::minus:
+    case operator_index::multiply:
+    case operator_index::divide:
+    case operator_index::power:
+    case operator_index::less:
+    case operator_index::less_equal:
+    case operator_index::greater:
+    case operator_index::greater_equal:
+    case operator_index::equal:
+    case operator_index::not_equal:
+    case operator_index::min:
+    case operator_index::max:
+    case operator_index::hypot:
+    case operator_index::atan2:
+        return 2;
+    case operator_index::select:
+    case operator_index::clamp:
+    case operator_index::fma:
+        return 3;
+    default:
+        return 1;
+    }
+}
+
+std::size_t cost(operator_index op) {
+    switch (op) {
+    case operator_index::constant:
+    case operator_index::variable:
+    case operator_index::argument:
+        return 0;
+    case operator_index::divide:
+    case operator_index::sqrt:
+    case operator_index::hypot:
+        return 8;
+    case operator_index::powi:
+        return 4;
+    case operator_index::sin:
+    case operator_index::cos:
+    case operator_index::tan:
+    case operator_index::exp:
+    case operator_index::exp2:
+    case operator_index::expm1:
+    case operator_index::log:
+    case operator_index::log10:
+    case operator_index::log2:
+    case operator_index::log1p:
+    case operator_index::cbrt:
+    case operator_index::atan:
+    case operator_index::asin:
+    case operator_index::acos:
+    case operator_index::atan2:
+    case operator_index::sinh:
+    case operator_index::cosh:
+    case operator_index::tanh:
+    case operator_index::asinh:
+    case operator_index::acosh:
+    case operator_index::atanh:
+        return 20;
+    case operator_index::erf:
+    case operator_index::erfc:
+        return 30;
+    case operator_index::power:
+        return 50;
+    case operator_index::tgamma:
+    case operator_index::lgamma:
+        return 80;
+    default:
+        return 1;
+    }
+}
+
+node build_tree(const std::vector<std::string>& polish_notation, const std::unordered_map<std::string, std::size_t>& variables,
+                const function_library* functions) {
+    const auto& arithmetic_operators = get_arithmetic_operators();
+    std::stack<node> calculation_values;
+    // missing operands are treated as zeros
+    const auto pop_element = [&calculation_values]() {
+        node elem;
+        if (!calculation_values.empty()) {
+            elem = std::move(calculation_values.top());
+            calculation_values.pop();
+        }
+        return elem;
+    };
+    for (const std::string& smth : polish_notation) {
+        if (utils::is_number(smth)) {
+            node constant;
+            constant.value = utils::get_number<double>(smth);
+            calculation_values.push(std::move(constant));
+        } else if (const auto variable = variables.find(smth); variable != variables.end()) {
+            node var;
+            var.op = operator_index::variable;
+            var.index = static_cast<std::int64_t>(variable->second);
+            calculation_values.push(std::move(var));
+        } else if (const auto op = arithmetic_operators.find(smth); op != arithmetic_operators.end()) {
+            std::vector<node> args(arity(op->second));
+            for (auto arg = args.rbegin(); arg != args.rend(); ++arg)
+                *arg = pop_element();
+            calculation_values.push(make_node(op->second, std::move(args)));
+        } else if (const auto function = functions != nullptr ? functions->find(smth) : nullptr) {
+            std::vector<node> args(function->arity);
+            for (auto arg = args.rbegin(); arg != args.rend(); ++arg)
+                *arg = pop_element();
+            calculation_values.push(inline_call(function->body, std::move(args)));
+        }
+    }
+    return pop_element();
+}
+
+node optimize(node tree) {
+    if (tree.op == operator_index::argument) {
+        shared_tree& shared = *tree.shared;
+        if (!shared.optimized) {
+            shared.tree = optimize(std::move(shared.tree));
+            shared.optimized = true;
+        }
+        // arguments which became leaves, e.g. folded constants, are used directly
+        return shared.tree.args.empty() ? shared.tree : tree;
+    }
+    // maximal polynomial subexpressions are found first, before their sums and products are fused
+    if (auto polynomial = make_polynomial(tree))
+        return std::move(*polynomial);
+    // sqrt(a^2 + b^2) -> hypot(a, b), checked before children are fused into fma
+    if (tree.op == operator_index::sqrt && tree.args[0].op == operator_index::plus) {
+        const node* a = squared_base(tree.args[0].args[0]);
+        const node* b = squared_base(tree.args[0].args[1]);
+        if (a != nullptr && b != nullptr)
+            return make_node(operator_index::hypot, {optimize(*a), optimize(*b)});
+    }
+    for (node& arg : tree.args)
+        arg = optimize(std::move(arg));
+    if (auto constant = fold_constants(tree))
+        return std::move(*constant);
+
+    switch (tree.op) {
+    case operator_index::unary_minus:
+        if (is_constant(tree.args[0])) {
+            tree.args[0].value = -tree.args[0].value;
+            return std::move(tree.args[0]);
+        }
+        break;
+    case operator_index::power:
+        // a^n -> powi(a, n) for small integer n
+        if (is_integer_constant(tree.args[1])) {
+            const auto exponent = static_cast<std::int64_t>(tree.args[1].value);
+            node res = make_node(operator_index::powi, {std::move(tree.args[0])});
+            res.index = exponent;
+            return res;
+        }
+        break;
+    case operator_index::plus:
+        // a * b + c -> fma(a, b, c)
+        for (std::size_t i = 0; i < 2; ++i) {
+            if (tree.args[i].op == operator_index::multiply) {
+                node product = std::move(tree.args[i]);
+                return make_node(operator_index::fma, {std::move(product.args[0]), std::move(product.args[1]), std::move(tree.args[1 - i])});
+            }
+        }
+        break;
+    default:
+        break;
+    }
+    return tree;
+}
+
+program::program(const node& tree, std::size_t variables_count) : _variables_count(variables_count) {
+    emitter{_code, _constants}(tree);
+}
+
+std::vector<std::size_t> program::levels() const {
+    std::vector<std::size_t> res(_code.size(), 0);
+    for (std::size_t i = 0; i < _code.size(); ++i) {
+        const instruction& ins = _code[i];
+        if (ins.op == operator_index::variable) {
+            res[i] = ins.args[0] + 1;
+            continue;
+        }
+        for (std::size_t k = 0; k < arity(ins.op); ++k)
+            res[i] = std::max(res[i], res[ins.args[k]]);
+    }
+    return res;
+}
+
+std::size_t program::size() const {
+    return _code.size();
+}
+
+std::size_t program::estimated_cost() const {
+    std::size_t res = 0;
+    for (const instruction& ins : _code)
+        res += ins.op == operator_index::polynomial ? ins.args[2] : cost(ins.op);
+    return res;
+}
+
+std::size_t program::variables_count() const {
+    return _variables_count;
+}
+
+const std::vector<instruction>& program::code() const {
+    return _code;
+}
+
+const std::vector<double>& program::constants() const {
+    return _constants;
+}
+
+std::size_t program::memory_footprint() const {
+    return sizeof(program) + _code.capacity() * sizeof(instruction) + _constants.capacity() * sizeof(double);
+}
+
+}
@@ -0,0 +1,304 @@
+#pragma once
+
+#include "utils.hpp"
+
+#include <array>
+#include <cmath>
+#include <memory>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Compiled representation of the run time formula. Polish notation is converted to the expression tree,
+// the tree is optimized and flattened into the tape of instructions: every instruction refers to the results of
+// previous ones, equal subexpressions are computed once.
+namespace parser {
+
+enum class operator_index : std::uint8_t {
+    plus, minus, unary_minus,
+    multiply, divide, power, sqr, sqrt, cbrt,
+    sin, asin, sinh, asinh, cos, acos, cosh, acosh, tan, atan, tanh, atanh,
+    exp, exp2, expm1, log, log10, log2, log1p,
+    abs, sign, ceil, floor, trunc, round,
+    tgamma, lgamma, erf, erfc,
+    less, less_equal, greater, greater_equal, equal, not_equal,
+    select, min, max, clamp,
+    fma, hypot, atan2, powi, polynomial,
+    // leaves
+    constant, variable,
+    // tree only: reference to an argument of inlined call which the body uses several times
+    argument
+};
+
+const std::unordered_map<std::string, operator_index>& get_arithmetic_operators();
+std::size_t arity(operator_index op);
+// Rough relative cost of the operator in additions, used to decide whether caching of results pays off.
+std::size_t cost(operator_index op);
+
+struct shared_tree;
+
+struct node {
+    operator_index op = operator_index::constant;
+    // value of constant
+    double value = 0;
+    // index of variable or exponent of powi
+    std::int64_t index = 0;
+    std::vector<node> args{};
+    // coefficients of polynomial in args[0], starting with free term
+    std::vector<double> coefficients{};
+    // tree of argument, all references to the argument share it
+    std::shared_ptr<shared_tree> shared{};
+};
+
+// Argument of inlined call is built, optimized and emitted once however many times the body uses it.
+struct shared_tree {
+    node tree;
+    bool optimized = false;
+};
+
+class function_library;
+
+// Calls of functions from the library are inlined.
+node build_tree(const std::vector<std::string>& polish_notation, const std::unordered_map<std::string, std::size_t>& variables,
+                const function_library* functions = nullptr);
+// Rewrites sums of monomials c * x^k of one variable into polynomial nodes (Horner scheme), products and powers
+// of sums stay factored. Fuses a * b + c into fma, sqrt(a^2 + b^2) into hypot and powers with integer constant
+// exponent into powi, negative literals become constants. Operators of integer constants with integer result are
+// folded into constants.
+node optimize(node tree);
+
+struct instruction {
+    operator_index op = operator_index::constant;
+    // Operands are indices of previous instructions. Constant and variable keep their index in args[0],
+    // powi keeps its exponent in args[1], polynomial keeps offset and number of its coefficients in constants
+    // in args[1] and args[2].
+    std::array<std::uint32_t, 3> args{};
+
+    auto operator<=>(const instruction&) const = default;
+};
+
+template<typename T>
+T apply(operator_index op, const T& a, const T& b, const T& c) {
+    using std::sin; using std::asin; using std::sinh; using std::asinh; using std::cos; using std::acos;
+    using std::cosh; using std::acosh; using std::tan; using std::atan; using std::tanh; using std::atanh;
+    using std::exp; using std::exp2; using std::expm1; using std::log; using std::log10; using std::log2;
+    using std::log1p; using std::abs; using std::ceil; using std::floor; using std::trunc; using std::round;
+    using std::tgamma; using std::lgamma; using std::erf; using std::erfc; using std::sqrt; using std::cbrt;
+    using std::pow; using std::fma; using std::hypot; using std::atan2; using std::min; using std::max;
+    using utils::sqr; using utils::select;
+    switch(op)
+    {
+    case operator_index::plus:
+        return a + b;
+    case operator_index::minus:
+        return a - b;
+    case operator_index::multiply:
+        return a * b;
+    case operator_index::divide:
+        return a / b;
+    case operator_index::power:
+        return pow(a, b);
+    case operator_index::unary_minus:
+        return -a;
+    case operator_index::sin:
+        return sin(a);
+    case operator_index::cos:
+        return cos(a);
+    case operator_index::tan:
+        return tan(a);
+    case operator_index::atan:
+        return atan(a);
+    case operator_index::exp:
+        return exp(a);
+    case operator_index::abs:
+        return abs(a);
+    case operator_index::sign:
+        return select(a > T(0), T(1), select(a < T(0), T(-1), T(0)));
+    case operator_index::sqr:
+        return sqr(a);
+    case operator_index::sqrt:
+        return sqrt(a);
+    case operator_index::log:
+        return log(a);
+    case operator_index::tgamma:
+        return tgamma(a);
+    case operator_index::lgamma:
+        return lgamma(a);
+    case operator_index::exp2:
+        return exp2(a);
+    case operator_index::expm1:
+        return expm1(a);
+    case operator_index::log10:
+        return log10(a);
+    case operator_index::log2:
+        return log2(a);
+    case operator_index::log1p:
+        return log1p(a);
+    case operator_index::cbrt:
+        return cbrt(a);
+    case operator_index::asin:
+        return asin(a);
+    case operator_index::acos:
+        return acos(a);
+    case operator_index::sinh:
+        return sinh(a);
+    case operator_index::cosh:
+        return cosh(a);
+    case operator_index::tanh:
+        return tanh(a);
+    case operator_index::asinh:
+        return asinh(a);
+    case operator_index::acosh:
+        return acosh(a);
+    case operator_index::atanh:
+        return atanh(a);
+    case operator_index::erf:
+        return erf(a);
+    case operator_index::erfc:
+        return erfc(a);
+    case operator_index::ceil:
+        return ceil(a);
+    case operator_index::floor:
+        return floor(a);
+    case operator_index::trunc:
+        return trunc(a);
+    case operator_index::round:
+        return round(a);
+    // comparisons give 1 or 0, selections evaluate all arguments and choose without branching,
+    // types with their own masks (see interval.hpp) overload select, min and max
+    case operator_index::less:
+        return T(a < b);
+    case operator_index::less_equal:
+        return T(a <= b);
+    case operator_index::greater:
+        return T(a > b);
+    case operator_index::greater_equal:
+        return T(a >= b);
+    case operator_index::equal:
+        return T(a == b);
+    case operator_index::not_equal:
+        return T(a != b);
+    case operator_index::min:
+        return min(a, b);
+    case operator_index::max:
+        return max(a, b);
+    case operator_index::select:
+        return select(a != T(0), b, c);
+    case operator_index::clamp:
+        return min(max(a, b), c);
+    case operator_index::fma:
+        return fma(a, b, c);
+    case operator_index::hypot:
+        return hypot(a, b);
+    case operator_index::atan2:
+        return atan2(a, b);
+    default:
+        return a;
+    }
+}
+
+// Computes instruction with operands taken from values of previous instructions.
+template<typename T>
+T execute(const instruction& ins, const T* values, const double* constants, const std::span<const T> input_variables) {
+    const auto& [a, b, c] = ins.args;
+    switch(ins.op)
+    {
+    case operator_index::constant:
+        return static_cast<T>(constants[a]);
+    case operator_index::variable:
+        return input_variables[a];
+    case operator_index::powi: {
+        using utils::powi;
+        return powi(values[a], static_cast<std::int32_t>(b));
+    }
+    case operator_index::polynomial:
+        return utils::horner(constants + b, c, values[a]);
+    default:
+        return apply<T>(ins.op, values[a], values[b], values[c]);
+    }
+}
+
+// Evaluates tape, result is the value of the last instruction. Input size is not verified here.
+template<typename T>
+T evaluate(const std::span<const instruction> code, const double* constants, const std::span<const T> input_variables) {
+    static constexpr std::size_t local_capacity = 64;
+    std::array<T, local_capacity> local;
+    std::vector<T> heap;
+    T* values = local.data();
+    if (code.size() > local_capacity) {
+        heap.resize(code.size());
+        values = heap.data();
+    }
+    for (std::size_t i = 0; i < code.size(); ++i)
+        values[i] = execute(code[i], values, constants, input_variables);
+    return values[code.size() - 1];
+}
+
+class program {
+public:
+    program() = default;
+    program(const node& tree, std::size_t variables_count);
+
+    // Input size is not verified here, see MathParser::operator().
+    template<typename T>
+    T evaluate(const std::span<const T> input_variables) const {
+        return parser::evaluate(std::span<const instruction>(_code), _constants.data(), input_variables);
+    }
+
+    // Evaluates on the tensor product of axes, axes[j] holds values of variable j. Output is row-major, the last
+    // axis changes fastest. Every instruction is computed in the outermost loop where it is invariant.
+    template<typename T>
+    void evaluate_grid(const std::span<const std::span<const T>> axes, const std::span<T> out) const {
+        const std::size_t dimensions = axes.size();
+        const std::vector<std::size_t> level = levels();
+        // partition of instructions by loop level, 0 is outside of all loops
+        std::vector<std::vector<std::uint32_t>> partition(dimensions + 1);
+        for (std::size_t i = 0; i < _code.size(); ++i)
+            partition[level[i]].push_back(static_cast<std::uint32_t>(i));
+
+        std::vector<T> values(_code.size());
+        std::vector<T> point(dimensions);
+        const auto compute = [this, &values, &point](const std::vector<std::uint32_t>& instructions) {
+            for (const std::uint32_t i : instructions)
+                values[i] = execute(_code[i], values.data(), _constants.data(), std::span<const T>(point));
+        };
+        compute(partition[0]);
+        if (dimensions == 0) {
+            out[0] = values.back();
+            return;
+        }
+        std::size_t position = 0;
+        const auto loop = [&](const auto& self, std::size_t depth) -> void {
+            const bool innermost = depth + 1 == dimensions;
+            for (const T& value : axes[depth]) {
+                point[depth] = value;
+                compute(partition[depth + 1]);
+                if (innermost)
+                    out[position++] = values.back();
+                else
+                    self(self, depth + 1);
+            }
+        };
+        loop(loop, 0);
+    }
+
+    // Loop level of every instruction: 0 for constants, otherwise 1 + the largest index of variable it depends on.
+    std::vector<std::size_t> levels() const;
+    std::size_t size() const;
+    // Sum of costs of all instructions.
+    std::size_t estimated_cost() const;
+    std::size_t variables_count() const;
+    const std::vector<instruction>& code() const;
+    const std::vector<double>& constants() const;
+    // Bytes owned by the program including its heap storage.
+    std::size_t memory_footprint() const;
+
+private:
+    std::vector<instruction> _code{};
+    std::vector<double> _constants{};
+    std::size_t _variables_count = 0;
+};
+
+}
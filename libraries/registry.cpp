@@ -0,0 +1,139 @@
+#include "registry.hpp"
+
+#include <stack>
+#include <thread>
+
+namespace {
+// Every thread owns an index of reader slot while it is alive, indices of finished threads are reused.
+class reader_index {
+public:
+    reader_index() {
+        std::lock_guard lock(mutex());
+        auto& released = free_indices();
+        if (released.empty()) {
+            _value = next_index()++;
+        } else {
+            _value = released.top();
+            released.pop();
+        }
+    }
+    ~reader_index() {
+        std::lock_guard lock(mutex());
+        free_indices().push(_value);
+    }
+    std::size_t value() const {
+        return _value;
+    }
+
+private:
+    static std::mutex& mutex() {
+        static std::mutex m;
+        return m;
+    }
+    static std::stack<std::size_t>& free_indices() {
+        static std::stack<std::size_t> indices;
+        return indices;
+    }
+    static std::size_t& next_index() {
+        static std::size_t index = 0;
+        return index;
+    }
+
+    std::size_t _value;
+};
+
+std::size_t current_reader() {
+    thread_local const reader_index index;
+    return index.value();
+}
+
+}
+
+namespace parser {
+
+formula_registry::read_guard::read_guard(const formula_registry& registry, const entry& e)
+    : _registry(registry), _reader(registry.enter()), _formula(e.current.load(std::memory_order_seq_cst)) {}
+
+formula_registry::read_guard::~read_guard() {
+    _registry.leave(_reader);
+}
+
+formula_registry::formula_registry(std::size_t max_readers)
+    : _max_readers(max_readers), _readers(std::make_unique<reader_slot[]>(max_readers)) {}
+
+formula_registry::~formula_registry() {
+    for (auto& [_, e] : _entries)
+        delete e->current.load();
+}
+
+formula_registry::handle formula_registry::publish(const std::string& name, MathParser formula) {
+    const MathParser* replacement = new MathParser(std::move(formula));
+    std::lock_guard writer(_writer_mutex);
+    entry* e = nullptr;
+    {
+        std::unique_lock names(_names_mutex);
+        auto& slot = _entries[name];
+        if (!slot)
+            slot = std::make_unique<entry>();
+        e = slot.get();
+    }
+    const MathParser* previous = e->current.exchange(replacement, std::memory_order_seq_cst);
+    if (previous != nullptr) {
+        synchronize(_epoch.fetch_add(1, std::memory_order_seq_cst) + 1);
+        delete previous;
+    }
+    return handle(e);
+}
+
+formula_registry::handle formula_registry::find(const std::string& name) const {
+    std::shared_lock names(_names_mutex);
+    const auto it = _entries.find(name);
+    if (it == _entries.end())
+        throw std::domain_error{"Formula <" + name + "> is not registered."};
+    return handle(it->second.get());
+}
+
+bool formula_registry::contains(const std::string& name) const {
+    std::shared_lock names(_names_mutex);
+    return _entries.contains(name);
+}
+
+std::size_t formula_registry::size() const {
+    std::shared_lock names(_names_mutex);
+    return _entries.size();
+}
+
+formula_registry::read_guard formula_registry::read(handle formula) const {
+    if (!formula.valid()) [[unlikely]]
+        throw std::domain_error{"Invalid formula handle."};
+    return read_guard(*this, *formula._entry);
+}
+
+std::size_t formula_registry::enter() const {
+    const std::size_t reader = current_reader();
+    if (reader >= _max_readers) [[unlikely]]
+        throw std::domain_error{"Too many reader threads for the formula registry."};
+    reader_slot& slot = _readers[reader];
+    // nested guards keep the epoch of the outermost one
+    if (slot.depth++ == 0)
+        slot.epoch.store(_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+    return reader;
+}
+
+void formula_registry::leave(std::size_t reader) const {
+    reader_slot& slot = _readers[reader];
+    if (--slot.depth == 0)
+        slot.epoch.store(0, std::memory_order_release);
+}
+
+void formula_registry::synchronize(std::uint64_t epoch) const {
+    // readers which entered before the epoch was advanced may still use the previous version
+    for (std::size_t reader = 0; reader < _max_readers; ++reader) {
+        const auto& slot = _readers[reader].epoch;
+        for (std::uint64_t announced = slot.load(std::memory_order_seq_cst); announced != 0 && announced < epoch;
+             announced = slot.load(std::memory_order_seq_cst))
+            std::this_thread::yield();
+    }
+}
+
+}
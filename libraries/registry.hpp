@@ -0,0 +1,99 @@
+#pragma once
+
+#include "parser.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Named formulas which are updated while other threads evaluate them. Reading is wait-free: a reader announces
+// the current epoch in its own slot, loads the formula pointer and clears the slot when it is done. A writer swaps
+// the pointer, advances the epoch and frees the old formula only after every reader which could see it has left.
+namespace parser {
+
+class formula_registry {
+    struct entry {
+        std::atomic<const MathParser*> current{nullptr};
+    };
+
+public:
+    // Resolved name. It stays valid for the registry lifetime and always refers to the latest published formula.
+    class handle {
+    public:
+        handle() = default;
+        bool valid() const { return _entry != nullptr; }
+
+    private:
+        friend class formula_registry;
+        explicit handle(const entry* e) : _entry(e) {}
+        const entry* _entry = nullptr;
+    };
+
+    // Keeps the formula alive while it is used. Guards can be nested within one thread, but the thread must not
+    // publish while it holds one.
+    class read_guard {
+    public:
+        read_guard(const read_guard&) = delete;
+        read_guard& operator=(const read_guard&) = delete;
+        ~read_guard();
+
+        const MathParser& operator*() const { return *_formula; }
+        const MathParser* operator->() const { return _formula; }
+
+    private:
+        friend class formula_registry;
+        read_guard(const formula_registry& registry, const entry& e);
+
+        const formula_registry& _registry;
+        std::size_t _reader;
+        const MathParser* _formula;
+    };
+
+    // Reader slots are indexed by a process wide number which every thread gets on its first read of any registry
+    // and keeps until it exits. read throws when that number is not below max_readers, so max_readers must exceed
+    // the number of live threads which have ever read some registry, not only of those reading this one now.
+    explicit formula_registry(std::size_t max_readers = 256);
+    ~formula_registry();
+    formula_registry(const formula_registry&) = delete;
+    formula_registry& operator=(const formula_registry&) = delete;
+
+    // Formula is compiled by the caller. Publishing replaces the previous version atomically and blocks only
+    // the writer until readers of the previous version finish.
+    handle publish(const std::string& name, MathParser formula);
+    handle find(const std::string& name) const;
+    bool contains(const std::string& name) const;
+    std::size_t size() const;
+
+    read_guard read(handle formula) const;
+
+    template <utils::arithmetic T>
+    T evaluate(handle formula, const std::span<const T> input_vars) const {
+        const read_guard guard = read(formula);
+        return (*guard)(input_vars);
+    }
+
+private:
+    struct alignas(64) reader_slot {
+        std::atomic<std::uint64_t> epoch{0};
+        // nesting level of read guards, touched only by the owner thread
+        std::size_t depth = 0;
+    };
+
+    std::size_t enter() const;
+    void leave(std::size_t reader) const;
+    void synchronize(std::uint64_t epoch) const;
+
+    std::size_t _max_readers;
+    std::unique_ptr<reader_slot[]> _readers;
+    std::atomic<std::uint64_t> _epoch{1};
+
+    mutable std::shared_mutex _names_mutex;
+    std::mutex _writer_mutex;
+    std::unordered_map<std::string, std::unique_ptr<entry>> _entries;
+};
+
+}
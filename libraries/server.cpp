@@ -0,0 +1,362 @@
+#include "server.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <list>
+#include <stdexcept>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+using parser::protocol::request_header;
+using parser::protocol::response_header;
+
+sockaddr_un make_address(const std::string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+        throw std::domain_error{"Socket path <" + path + "> is too long."};
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+// false if the peer closed the connection
+bool read_all(int fd, void* data, std::size_t size) {
+    auto* bytes = static_cast<char*>(data);
+    while (size > 0) {
+        const ssize_t count = ::recv(fd, bytes, size, 0);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        bytes += count;
+        size -= static_cast<std::size_t>(count);
+    }
+    return true;
+}
+
+// reads and drops payload of a rejected request, false if the peer closed the connection
+bool skip_all(int fd, std::uint64_t size) {
+    std::array<char, 65536> buffer;
+    while (size > 0) {
+        const std::size_t count = std::min<std::uint64_t>(size, buffer.size());
+        if (!read_all(fd, buffer.data(), count))
+            return false;
+        size -= count;
+    }
+    return true;
+}
+
+bool write_all(int fd, const void* data, std::size_t size) {
+    const auto* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        const ssize_t count = ::send(fd, bytes, size, MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        bytes += count;
+        size -= static_cast<std::size_t>(count);
+    }
+    return true;
+}
+
+bool write_error(int fd, const std::string& message) {
+    const response_header header{1, 0, message.size()};
+    return write_all(fd, &header, sizeof(header)) && write_all(fd, message.data(), message.size());
+}
+
+std::array<std::uint64_t, parser::statistics_words> to_words(const parser::server_statistics& stats) {
+    std::array<std::uint64_t, parser::statistics_words> words{stats.requests, stats.rows, stats.errors, stats.latency_sum_ns, stats.latency_max_ns};
+    std::copy(stats.latency_histogram.begin(), stats.latency_histogram.end(), words.begin() + 5);
+    return words;
+}
+
+parser::server_statistics from_words(const std::array<std::uint64_t, parser::statistics_words>& words) {
+    parser::server_statistics stats{words[0], words[1], words[2], words[3], words[4]};
+    std::copy(words.begin() + 5, words.end(), stats.latency_histogram.begin());
+    return stats;
+}
+
+}
+
+namespace parser {
+
+double server_statistics::mean_latency_us() const {
+    return requests == 0 ? 0. : double(latency_sum_ns) / double(requests) / 1000.;
+}
+
+double server_statistics::latency_quantile_us(double q) const {
+    std::uint64_t total = 0;
+    for (const std::uint64_t count : latency_histogram)
+        total += count;
+    if (total == 0)
+        return 0.;
+    const auto rank = static_cast<std::uint64_t>(std::clamp(q, 0., 1.) * double(total - 1));
+    std::uint64_t seen = 0;
+    for (std::size_t bucket = 0; bucket < buckets; ++bucket) {
+        seen += latency_histogram[bucket];
+        if (seen > rank)
+            return double(std::uint64_t(1) << (bucket + 1));
+    }
+    return double(std::uint64_t(1) << buckets);
+}
+
+batch_server::batch_server(std::string socket_path, std::vector<compiled_formula> formulas, std::size_t threads)
+    : _path(std::move(socket_path)), _formulas(std::move(formulas)), _threads(threads) {
+    const sockaddr_un address = make_address(_path);
+    _listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (_listener < 0)
+        throw std::domain_error{"Can not create socket."};
+    ::unlink(_path.c_str());
+    if (::bind(_listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(_listener, SOMAXCONN) != 0) {
+        ::close(_listener);
+        throw std::domain_error{"Can not listen to socket <" + _path + ">: " + std::strerror(errno) + "."};
+    }
+}
+
+batch_server::~batch_server() {
+    stop();
+    ::close(_listener);
+    ::unlink(_path.c_str());
+}
+
+void batch_server::run() {
+    struct connection {
+        std::atomic<bool> done{false};
+        std::jthread thread;
+    };
+    // list keeps the done flags in place while threads refer to them
+    std::list<connection> connections;
+    while (!_stopped.load()) {
+        const int client = ::accept(_listener, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;
+        }
+        // threads of closed connections are joined, so many short connections do not accumulate them
+        connections.remove_if([](const connection& c) { return c.done.load(); });
+        std::lock_guard lock(_clients_mutex);
+        if (_stopped.load()) {
+            ::close(client);
+            break;
+        }
+        _clients.push_back(client);
+        connection& c = connections.emplace_back();
+        c.thread = std::jthread([this, client, &done = c.done]() {
+            serve(client);
+            done.store(true);
+        });
+    }
+    // connections blocked in reading are woken up, their threads close sockets
+    {
+        std::lock_guard lock(_clients_mutex);
+        for (const int client : _clients)
+            ::shutdown(client, SHUT_RDWR);
+    }
+    connections.clear();
+}
+
+void batch_server::stop() {
+    _stopped.store(true);
+    ::shutdown(_listener, SHUT_RDWR);
+}
+
+server_statistics batch_server::statistics() const {
+    server_statistics res{_requests.load(), _rows.load(), _errors.load(), _latency_sum_ns.load(), _latency_max_ns.load()};
+    for (std::size_t bucket = 0; bucket < server_statistics::buckets; ++bucket)
+        res.latency_histogram[bucket] = _latency_histogram[bucket].load();
+    return res;
+}
+
+const std::string& batch_server::path() const {
+    return _path;
+}
+
+void batch_server::record(std::uint64_t latency_ns, std::uint64_t rows, bool error) {
+    _requests.fetch_add(1, std::memory_order_relaxed);
+    _rows.fetch_add(rows, std::memory_order_relaxed);
+    _errors.fetch_add(error, std::memory_order_relaxed);
+    _latency_sum_ns.fetch_add(latency_ns, std::memory_order_relaxed);
+    for (std::uint64_t max = _latency_max_ns.load(std::memory_order_relaxed);
+         max < latency_ns && !_latency_max_ns.compare_exchange_weak(max, latency_ns, std::memory_order_relaxed);) {}
+    const std::uint64_t microseconds = latency_ns / 1000;
+    const std::size_t bucket = microseconds == 0 ? 0 : std::min<std::size_t>(std::bit_width(microseconds) - 1, server_statistics::buckets - 1);
+    _latency_histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void batch_server::serve(int client) {
+    try {
+        serve_requests(client);
+    } catch (const std::exception& e) {
+        // e.g. allocation of a large request failed, the connection is closed after the error response
+        _errors.fetch_add(1, std::memory_order_relaxed);
+        write_error(client, std::string("Server error: ") + e.what());
+    }
+    std::lock_guard lock(_clients_mutex);
+    _clients.erase(std::find(_clients.begin(), _clients.end(), client));
+    ::close(client);
+}
+
+void batch_server::serve_requests(int client) {
+    std::vector<double> input;
+    std::vector<double> output;
+    std::vector<std::span<const double>> columns;
+    request_header request{};
+    while (read_all(client, &request, sizeof(request))) {
+        const auto start = std::chrono::steady_clock::now();
+        bool error = false;
+        bool written = true;
+        std::uint64_t rows = 0;
+        if (request.kind == protocol::request_kind::evaluate) {
+            rows = request.size;
+            const std::uint64_t values = rows * request.columns;
+            if (rows > protocol::max_request_rows || values > protocol::max_request_values) {
+                write_error(client, "Request is too large.");
+                break;
+            }
+            // requests are validated before buffers are allocated, payload of a wrong request is dropped
+            if (request.formula >= _formulas.size()) {
+                error = true;
+                written = skip_all(client, values * sizeof(double)) &&
+                          write_error(client, "Unknown formula id " + std::to_string(request.formula) + ".");
+            } else if (const MathParser& formula = _formulas[request.formula].formula; formula.variables_count() != request.columns) {
+                error = true;
+                written = skip_all(client, values * sizeof(double)) &&
+                          write_error(client, "Formula <" + _formulas[request.formula].name + "> takes " +
+                                              std::to_string(formula.variables_count()) + " columns.");
+            } else {
+                input.resize(values);
+                if (!read_all(client, input.data(), values * sizeof(double)))
+                    break;
+                columns.clear();
+                for (std::size_t j = 0; j < request.columns; ++j)
+                    columns.emplace_back(input.data() + j * rows, rows);
+                output.resize(rows);
+                formula.evaluate_batch(std::span<const std::span<const double>>(columns), std::span(output), _threads);
+                const response_header header{0, 0, rows};
+                written = write_all(client, &header, sizeof(header)) && write_all(client, output.data(), rows * sizeof(double));
+            }
+        } else if (request.kind == protocol::request_kind::resolve) {
+            if (request.size > 4096) {
+                write_error(client, "Request is too large.");
+                break;
+            }
+            std::string name(request.size, '\0');
+            if (!read_all(client, name.data(), name.size()))
+                break;
+            const auto it = std::find_if(_formulas.begin(), _formulas.end(), [&name](const compiled_formula& f) { return f.name == name; });
+            if (it == _formulas.end()) {
+                error = true;
+                written = write_error(client, "Formula <" + name + "> is not served.");
+            } else {
+                const auto columns = static_cast<std::uint32_t>(it->formula.variables_count());
+                const response_header header{0, columns, std::uint64_t(it - _formulas.begin())};
+                written = write_all(client, &header, sizeof(header));
+            }
+        } else if (request.kind == protocol::request_kind::statistics) {
+            const auto words = to_words(statistics());
+            const response_header header{0, 0, words.size()};
+            // statistics requests are not counted
+            if (!write_all(client, &header, sizeof(header)) || !write_all(client, words.data(), sizeof(words)))
+                break;
+            continue;
+        } else {
+            write_error(client, "Unknown request.");
+            break;
+        }
+        const auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        record(static_cast<std::uint64_t>(latency.count()), error ? 0 : rows, error);
+        if (!written)
+            break;
+    }
+}
+
+batch_client::batch_client(const std::string& socket_path) {
+    const sockaddr_un address = make_address(socket_path);
+    _socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (_socket < 0)
+        throw std::domain_error{"Can not create socket."};
+    if (::connect(_socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        ::close(_socket);
+        throw std::domain_error{"Can not connect to <" + socket_path + ">: " + std::strerror(errno) + "."};
+    }
+}
+
+batch_client::~batch_client() {
+    ::close(_socket);
+}
+
+served_formula batch_client::resolve(const std::string& name) {
+    const request_header request{protocol::request_kind::resolve, 0, 0, 0, name.size()};
+    if (!write_all(_socket, &request, sizeof(request)) || !write_all(_socket, name.data(), name.size()))
+        throw std::domain_error{"Connection is closed by the server."};
+    const response_header header = receive_header();
+    return {static_cast<std::uint32_t>(header.count), header.columns};
+}
+
+void batch_client::send(std::uint32_t formula, const std::span<const std::span<const double>> columns) {
+    const std::size_t rows = columns.empty() ? 0 : columns[0].size();
+    for (const auto& column : columns)
+        if (column.size() != rows)
+            throw std::domain_error{"Wrong number of rows. Every column must contain the same number of values."};
+    if (rows > protocol::max_request_rows || rows * columns.size() > protocol::max_request_values)
+        throw std::domain_error{"Request is too large. Split it into batches of at most " + std::to_string(protocol::max_request_rows) + " rows."};
+    const request_header request{protocol::request_kind::evaluate, formula, static_cast<std::uint32_t>(columns.size()), 0, rows};
+    bool written = write_all(_socket, &request, sizeof(request));
+    for (const auto& column : columns)
+        written = written && write_all(_socket, column.data(), column.size_bytes());
+    if (!written)
+        throw std::domain_error{"Connection is closed by the server."};
+}
+
+void batch_client::receive(const std::span<double> out) {
+    const std::uint64_t rows = receive_header().count;
+    if (rows == out.size()) {
+        if (!read_all(_socket, out.data(), out.size_bytes()))
+            throw std::domain_error{"Connection is closed by the server."};
+        return;
+    }
+    // the response is consumed anyway to keep the connection usable
+    _buffer.resize(rows);
+    if (!read_all(_socket, _buffer.data(), rows * sizeof(double)))
+        throw std::domain_error{"Connection is closed by the server."};
+    throw std::domain_error{"Wrong output size. Server returned " + std::to_string(rows) + " values."};
+}
+
+void batch_client::evaluate(std::uint32_t formula, const std::span<const std::span<const double>> columns, const std::span<double> out) {
+    send(formula, columns);
+    receive(out);
+}
+
+server_statistics batch_client::statistics() {
+    const request_header request{protocol::request_kind::statistics, 0, 0, 0, 0};
+    if (!write_all(_socket, &request, sizeof(request)))
+        throw std::domain_error{"Connection is closed by the server."};
+    std::array<std::uint64_t, statistics_words> words{};
+    if (receive_header().count != words.size() || !read_all(_socket, words.data(), sizeof(words)))
+        throw std::domain_error{"Wrong statistics response."};
+    return from_words(words);
+}
+
+response_header batch_client::receive_header() {
+    response_header header{};
+    if (!read_all(_socket, &header, sizeof(header)))
+        throw std::domain_error{"Connection is closed by the server."};
+    if (header.status == 0)
+        return header;
+    std::string message(header.count, '\0');
+    if (!read_all(_socket, message.data(), message.size()))
+        throw std::domain_error{"Connection is closed by the server."};
+    throw std::domain_error{message};
+}
+
+}
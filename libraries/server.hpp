@@ -0,0 +1,143 @@
+#pragma once
+
+#include "bulk.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+
+// Batch evaluation of a shared formula set for local processes over a Unix domain socket. A connection carries
+// pipelined requests, responses come back in the order of requests. Every message starts with a fixed header in
+// the native byte order followed by payload:
+//   evaluate: formula id, columns, rows, then columns * rows doubles column by column -> rows doubles
+//   resolve:  name length, then name bytes -> formula id in the count and its columns in the response header
+//   statistics: -> server_statistics as statistics_words 64-bit integers
+// An error response carries the message instead of payload, the connection stays usable.
+namespace parser {
+
+namespace protocol {
+
+enum class request_kind : std::uint32_t { evaluate = 1, resolve = 2, statistics = 3 };
+
+struct request_header {
+    request_kind kind;
+    std::uint32_t formula;
+    std::uint32_t columns;
+    std::uint32_t reserved;
+    // rows of evaluate, bytes of name for resolve
+    std::uint64_t size;
+};
+
+struct response_header {
+    // 0 on success, otherwise payload is error message of count bytes
+    std::uint32_t status;
+    // number of columns of the resolved formula
+    std::uint32_t columns;
+    std::uint64_t count;
+};
+
+static_assert(sizeof(request_header) == 24 && sizeof(response_header) == 16);
+
+// Requests larger than this are rejected and the connection is closed. Rows are limited separately, because the
+// output has a value per row even for formulas without variables.
+inline constexpr std::uint64_t max_request_values = std::uint64_t(1) << 28;
+inline constexpr std::uint64_t max_request_rows = std::uint64_t(1) << 22;
+
+}
+
+struct server_statistics {
+    // bucket k counts requests with latency in [2^k, 2^(k + 1)) microseconds, the first one also faster requests
+    static constexpr std::size_t buckets = 32;
+
+    std::uint64_t requests = 0;
+    std::uint64_t rows = 0;
+    std::uint64_t errors = 0;
+    std::uint64_t latency_sum_ns = 0;
+    std::uint64_t latency_max_ns = 0;
+    std::array<std::uint64_t, buckets> latency_histogram{};
+
+    double mean_latency_us() const;
+    // Upper bound of the bucket which contains the quantile q from [0, 1].
+    double latency_quantile_us(double q) const;
+};
+
+inline constexpr std::size_t statistics_words = 5 + server_statistics::buckets;
+
+class batch_server {
+public:
+    // Formula id is the index in formulas. The socket is bound and listened to by the constructor, an existing
+    // file at the path is replaced. threads is used by every batch of every connection, 0 means all hardware threads.
+    // Connections are already served concurrently, so the default of one thread per connection does not oversubscribe.
+    batch_server(std::string socket_path, std::vector<compiled_formula> formulas, std::size_t threads = 1);
+    // run() must have returned before the server is destroyed.
+    ~batch_server();
+    batch_server(const batch_server&) = delete;
+    batch_server& operator=(const batch_server&) = delete;
+
+    // Accepts connections and serves each of them by its own thread until stop(). Threads of closed connections
+    // are joined when the next connection is accepted.
+    void run();
+    // Can be called from any thread or a signal handler of the thread which does not run the server.
+    void stop();
+
+    server_statistics statistics() const;
+    const std::string& path() const;
+
+private:
+    // serves requests until the connection is closed, errors of the server close the connection
+    void serve(int client);
+    void serve_requests(int client);
+    void record(std::uint64_t latency_ns, std::uint64_t rows, bool error);
+
+    std::string _path;
+    std::vector<compiled_formula> _formulas;
+    std::size_t _threads;
+    int _listener = -1;
+    std::atomic<bool> _stopped{false};
+
+    std::mutex _clients_mutex;
+    std::vector<int> _clients;
+
+    std::atomic<std::uint64_t> _requests{0};
+    std::atomic<std::uint64_t> _rows{0};
+    std::atomic<std::uint64_t> _errors{0};
+    std::atomic<std::uint64_t> _latency_sum_ns{0};
+    std::atomic<std::uint64_t> _latency_max_ns{0};
+    std::array<std::atomic<std::uint64_t>, server_statistics::buckets> _latency_histogram{};
+};
+
+// Connection to batch_server. Requests can be pipelined: several send() before receive(), responses of pending
+// requests must fit into the socket buffers unless another thread receives them. Errors are thrown as
+// std::domain_error, an error of one request does not break the connection.
+struct served_formula {
+    std::uint32_t id;
+    std::uint32_t columns;
+};
+
+class batch_client {
+public:
+    explicit batch_client(const std::string& socket_path);
+    ~batch_client();
+    batch_client(const batch_client&) = delete;
+    batch_client& operator=(const batch_client&) = delete;
+
+    served_formula resolve(const std::string& name);
+    void send(std::uint32_t formula, std::span<const std::span<const double>> columns);
+    // Result of the oldest pending request.
+    void receive(std::span<double> out);
+    void evaluate(std::uint32_t formula, std::span<const std::span<const double>> columns, std::span<double> out);
+    server_statistics statistics();
+
+private:
+    // Reads response header, throws with the message of error response.
+    protocol::response_header receive_header();
+
+    int _socket = -1;
+    std::vector<double> _buffer;
+};
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "expression.hpp"
+
+#include <span>
+#include <stdexcept>
+
+#if __has_include(<experimental/simd>)
+#include <experimental/simd>
+#define PARSER_HAS_SIMD 1
+#else
+#define PARSER_HAS_SIMD 0
+#endif
+
+namespace parser::ex {
+// Packed evaluation of expression templates: one call of expression with std::array<pack<T>, M> evaluates
+// pack_traits<pack<T>>::width rows at once. Without <experimental/simd> pack<T> falls back to T (width 1).
+#if PARSER_HAS_SIMD
+namespace stdx = std::experimental;
+
+template<typename T>
+using pack = stdx::native_simd<T>;
+
+template<typename T, typename Abi>
+struct pack_traits<stdx::simd<T, Abi>> {
+    using type = stdx::simd<T, Abi>;
+    using value_type = T;
+    static constexpr std::size_t width = type::size();
+
+    static type select(const typename type::mask_type& mask, const type& a, const type& b) {
+        type res = b;
+        stdx::where(mask, res) = a;
+        return res;
+    }
+    static type load(const value_type* ptr) {
+        return type(ptr, stdx::element_aligned);
+    }
+    static void store(const type& value, value_type* ptr) {
+        value.copy_to(ptr, stdx::element_aligned);
+    }
+};
+#else
+template<typename T>
+using pack = T;
+#endif
+
+// Evaluates expression over columnar data: columns[j][i] is the value of variable<j> in row i.
+// Rows are processed in pack-wide chunks, the remainder is evaluated with scalars.
+template<expression_node E, typename T, std::size_t M>
+void evaluate_batch(const E& e, const std::array<std::span<const T>, M>& columns, std::span<T> out) {
+    using traits = pack_traits<pack<T>>;
+    const std::size_t rows = out.size();
+    for (const auto& column : columns)
+        if (column.size() < rows)
+            throw std::domain_error{"Wrong number of rows. Every column must contain at least as many values as output."};
+
+    std::size_t i = 0;
+    for (; i + traits::width <= rows; i += traits::width) {
+        std::array<pack<T>, M> packed;
+        for (std::size_t j = 0; j < M; ++j)
+            packed[j] = traits::load(columns[j].data() + i);
+        traits::store(pack<T>(e(packed)), out.data() + i);
+    }
+    for (; i < rows; ++i) {
+        std::array<T, M> row;
+        for (std::size_t j = 0; j < M; ++j)
+            row[j] = columns[j][i];
+        out[i] = e(row);
+    }
+}
+
+}
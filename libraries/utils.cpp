@@ -1,5 +1,9 @@
 #include "utils.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numbers>
 #include <numeric>
 #include <stdexcept>
 
@@ -21,6 +25,12 @@ std::size_t count_all(const std::string& s, char symb) {
     return std::accumulate(s.begin(), s.end(), std::size_t(0), [&](std::size_t res, char a){ return res + std::size_t(a == symb); });
 }
 
+std::size_t heap_size(const std::string& s) {
+    // capacity of an empty string is the size of the small string buffer
+    static const std::size_t local_capacity = std::string().capacity();
+    return s.capacity() > local_capacity ? s.capacity() + 1 : 0;
+}
+
 bool is_latin_str(const std::string& s) {
     if (s.size() == 0 || s.size() > 1)
         throw std::domain_error{"Wrong format, latyn symbol contains of one symbol."};
@@ -39,4 +49,18 @@ bool is_number(const std::string& s) {
     return true;
 };
 
-}
\ No newline at end of file
+double digamma(double x) {
+    if (x <= 0 && std::floor(x) == x)
+        return std::numeric_limits<double>::quiet_NaN();
+    // reflection psi(1 - x) - psi(x) = pi * cot(pi * x)
+    if (x < 0.5)
+        return digamma(1 - x) - std::numbers::pi / std::tan(std::numbers::pi * x);
+    // recurrence psi(x + 1) = psi(x) + 1 / x up to the range of the asymptotic series
+    double res = 0;
+    for (; x < 6; x += 1)
+        res -= 1 / x;
+    const double f = 1 / (x * x);
+    return res + std::log(x) - 0.5 / x - f * (1. / 12 - f * (1. / 120 - f * (1. / 252 - f * (1. / 240 - f / 132))));
+}
+
+}
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <array>
+#include <cmath>
 #include <string>
 #include <concepts>
+#include <cstdint>
 
 namespace parser::utils {
 
@@ -12,9 +15,77 @@ std::string trim(std::string str);
 std::string& delete_all(std::string& str, char symb);
 std::size_t count_all(const std::string& s, char symb);
 
+// Heap bytes of string, zero when it is kept in the small string buffer.
+std::size_t heap_size(const std::string& s);
+
 bool is_latin_str(const std::string& s);
 bool is_number(const std::string& s);
 
+// Logarithmic derivative of gamma function, derivative of lgamma. NaN at poles.
+double digamma(double x);
+
+// Generic versions of operations which types with more information than a value (intervals) overload,
+// they are called unqualified after `using utils::f;`.
+template<typename T>
+T sqr(const T& x) {
+    return x * x;
+}
+
+template<typename Mask, typename T>
+T select(const Mask& mask, const T& a, const T& b) {
+    return mask ? a : b;
+}
+
+// Integer power by squaring. Negative powers of integers are computed by std::pow as before, 1 / 0 is not an error there.
+template<typename T>
+T powi(T base, std::int32_t exponent) {
+    if constexpr (std::integral<T>)
+        if (exponent < 0)
+            return static_cast<T>(std::pow(base, exponent));
+    std::uint32_t n = exponent < 0 ? -std::uint32_t(exponent) : std::uint32_t(exponent);
+    T res = T(1);
+    while (n > 0) {
+        if (n & 1u)
+            res *= base;
+        base *= base;
+        n >>= 1;
+    }
+    return exponent < 0 ? T(1) / res : res;
+}
+
+// Polynomial coefficients[0] + coefficients[1] * x + ... by Horner scheme, one fma per coefficient.
+template<typename T>
+T horner(const double* coefficients, std::size_t count, const T& x) {
+    using std::fma;
+    T res = T(coefficients[count - 1]);
+    for (std::size_t k = count - 1; k > 0; --k)
+        res = fma(res, x, T(coefficients[k - 1]));
+    return res;
+}
+
+// The same polynomial by Estrin scheme: terms are combined pairwise with x, x^2, x^4, ..., so fma of one level
+// are independent. It does a few more multiplications than Horner but has logarithmic dependency chain.
+template<typename T, std::size_t MaxCount = 65>
+T estrin(const double* coefficients, std::size_t count, const T& x) {
+    using std::fma;
+    std::array<T, (MaxCount + 1) / 2> terms;
+    std::size_t size = (count + 1) / 2;
+    for (std::size_t i = 0; i < count / 2; ++i)
+        terms[i] = fma(T(coefficients[2 * i + 1]), x, T(coefficients[2 * i]));
+    if (count % 2 == 1)
+        terms[size - 1] = T(coefficients[count - 1]);
+    T power = x * x;
+    while (size > 1) {
+        for (std::size_t i = 0; i < size / 2; ++i)
+            terms[i] = fma(terms[2 * i + 1], power, terms[2 * i]);
+        if (size % 2 == 1)
+            terms[size / 2] = terms[size - 1];
+        size = (size + 1) / 2;
+        power = power * power;
+    }
+    return terms[0];
+}
+
 template<arithmetic T>
 T get_number(const std::string& number, std::size_t* idx = 0, int base = 10) {
     if constexpr (std::is_same_v<T, float>)       
@@ -0,0 +1,84 @@
+#include "server.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <random>
+#include <thread>
+
+// Usage: BatchLoad <socket path> <formula name> [rows] [requests] [connections] [pipeline depth]
+// Every connection sends requests of random columns keeping up to depth of them in flight.
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <socket path> <formula name> [rows] [requests] [connections] [pipeline depth]" << std::endl;
+        return 2;
+    }
+    try {
+        const std::size_t rows = argc > 3 ? std::stoul(argv[3]) : 1024;
+        const std::size_t requests = argc > 4 ? std::stoul(argv[4]) : 1000;
+        const std::size_t connections = std::max<std::size_t>(argc > 5 ? std::stoul(argv[5]) : 1, 1);
+        const std::size_t depth = std::max<std::size_t>(argc > 6 ? std::stoul(argv[6]) : 4, 1);
+        const parser::served_formula formula = parser::batch_client(argv[1]).resolve(argv[2]);
+
+        std::vector<std::vector<double>> latencies(connections);
+        // errors of connections are rethrown after all of them have finished
+        std::vector<std::exception_ptr> errors(connections);
+        const auto start = std::chrono::steady_clock::now();
+        {
+            std::vector<std::jthread> workers;
+            for (std::size_t c = 0; c < connections; ++c)
+                workers.emplace_back([&, c]() {
+                    try {
+                        std::mt19937_64 generator(c);
+                        std::uniform_real_distribution<double> distribution(0.5, 2.);
+                        std::vector<std::vector<double>> columns(formula.columns, std::vector<double>(rows));
+                        for (auto& column : columns)
+                            std::generate(column.begin(), column.end(), [&]() { return distribution(generator); });
+                        const std::vector<std::span<const double>> spans(columns.begin(), columns.end());
+                        std::vector<double> out(rows);
+                        std::vector<std::chrono::steady_clock::time_point> sent;
+                        parser::batch_client client(argv[1]);
+                        const std::size_t count = requests / connections + (c < requests % connections);
+                        std::size_t received = 0;
+                        for (std::size_t k = 0; k < count; ++k) {
+                            if (k - received == depth) {
+                                client.receive(out);
+                                latencies[c].push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - sent[received++]).count());
+                            }
+                            sent.push_back(std::chrono::steady_clock::now());
+                            client.send(formula.id, spans);
+                        }
+                        for (; received < count; ++received) {
+                            client.receive(out);
+                            latencies[c].push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - sent[received]).count());
+                        }
+                    } catch (...) {
+                        errors[c] = std::current_exception();
+                    }
+                });
+        }
+        for (const std::exception_ptr& error : errors)
+            if (error)
+                std::rethrow_exception(error);
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::vector<double> all;
+        for (const auto& connection : latencies)
+            all.insert(all.end(), connection.begin(), connection.end());
+        std::sort(all.begin(), all.end());
+        const auto quantile = [&all](double q) { return all.empty() ? 0. : all[static_cast<std::size_t>(q * double(all.size() - 1))]; };
+        std::cout << all.size() << " requests of " << rows << " rows in " << seconds << " s: " << double(all.size()) / seconds
+                  << " requests/s, " << double(all.size() * rows) / seconds << " rows/s" << std::endl;
+        std::cout << "latency us: p50 " << quantile(0.5) << ", p90 " << quantile(0.9) << ", p99 " << quantile(0.99)
+                  << ", max " << quantile(1.) << std::endl;
+
+        const auto stats = parser::batch_client(argv[1]).statistics();
+        std::cout << "server: " << stats.requests << " requests, " << stats.errors << " errors, mean latency "
+                  << stats.mean_latency_us() << " us, p99 below " << stats.latency_quantile_us(0.99) << " us" << std::endl;
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    }
+}
@@ -0,0 +1,48 @@
+#include "server.hpp"
+
+#include <csignal>
+#include <iostream>
+
+namespace {
+parser::batch_server* running_server = nullptr;
+
+void stop_server(int) {
+    if (running_server != nullptr)
+        running_server->stop();
+}
+}
+
+// Usage: BatchServer <socket path> <formulas file> [threads]
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <socket path> <formulas file> [threads]" << std::endl;
+        return 2;
+    }
+    const std::size_t threads = argc > 3 ? std::stoul(argv[3]) : 1;
+    try {
+        auto compiled = parser::compile_file(argv[2]);
+        for (const auto& d : compiled.diagnostics)
+            std::cerr << argv[2] << ":" << d.line << ": " << (d.level == parser::diagnostic::severity::error ? "error: " : "warning: ")
+                      << d.message << std::endl;
+        if (compiled.errors != 0)
+            return 1;
+        for (std::size_t id = 0; id < compiled.formulas.size(); ++id)
+            std::cout << id << " " << compiled.formulas[id].name << " = |" << compiled.formulas[id].source << "|" << std::endl;
+
+        parser::batch_server server(argv[1], std::move(compiled.formulas), threads);
+        running_server = &server;
+        std::signal(SIGINT, stop_server);
+        std::signal(SIGTERM, stop_server);
+        std::cout << "Listening to " << server.path() << std::endl;
+        server.run();
+        running_server = nullptr;
+
+        const auto stats = server.statistics();
+        std::cout << stats.requests << " requests, " << stats.rows << " rows, " << stats.errors << " errors, mean latency "
+                  << stats.mean_latency_us() << " us, p99 below " << stats.latency_quantile_us(0.99) << " us" << std::endl;
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    }
+}
@@ -0,0 +1,24 @@
+#include "bulk.hpp"
+
+#include <iostream>
+
+// Usage: BulkCompile <formulas file> [threads]
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <formulas file> [threads]" << std::endl;
+        return 2;
+    }
+    try {
+        const std::size_t threads = argc > 2 ? std::stoul(argv[2]) : 0;
+        const auto res = parser::compile_file(argv[1], threads);
+        for (const auto& d : res.diagnostics)
+            std::cerr << argv[1] << ":" << d.line << ": " << (d.level == parser::diagnostic::severity::error ? "error: " : "warning: ")
+                      << d.message << std::endl;
+        std::cout << res.formulas.size() << " formulas compiled, " << res.errors << " errors, "
+                  << res.seconds << " s, " << res.formulas_per_second() << " formulas/s" << std::endl;
+        return res.errors == 0 ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    }
+}
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+// Compile time benchmark of expression templates. For every size a program with one expression of about that many
+// nodes is generated, compiled and run. Reported are the median over rounds of -O2 compile CPU time minus the time of
+// the same program with a trivial expression compiled right before it, size of the -O0 object which grows with
+// instantiated symbols and time of one evaluation.
+// Usage: ExpressionBenchmark [nodes...], sizes are 100 250 500 1000 by default.
+namespace {
+
+// deterministic sequence, results must be comparable between builds
+struct generator {
+    std::uint64_t state = 42;
+    std::size_t operator()(std::size_t bound) {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        return static_cast<std::size_t>(state >> 33) % bound;
+    }
+};
+
+std::string factor(generator& random, std::size_t& nodes) {
+    static const std::vector<std::pair<const char*, std::size_t>> factors{
+        {"x", 1}, {"y", 1}, {"z", 1}, {"_(0.5)", 1}, {"sin(x)", 2}, {"exp(_(0.1) * y)", 4},
+        {"sqrt(z)", 2}, {"(x - y)", 3}, {"pow(x, int_constant<2>())", 3}, {"(y / z)", 3}};
+    const auto& [text, size] = factors[random(factors.size())];
+    nodes += size;
+    return text;
+}
+
+std::string make_expression(std::size_t target) {
+    if (target == 0)
+        return "x + y";
+    generator random;
+    std::size_t nodes = 0;
+    std::string res;
+    while (nodes < target) {
+        if (!res.empty()) {
+            res += random(4) == 0 ? " - " : " + ";
+            ++nodes;
+        }
+        const std::size_t factors = 2 + random(2);
+        for (std::size_t k = 0; k < factors; ++k) {
+            if (k > 0) {
+                res += " * ";
+                ++nodes;
+            }
+            res += factor(random, nodes);
+        }
+    }
+    return res;
+}
+
+void write_program(const std::filesystem::path& source, std::size_t size) {
+    std::ofstream out(source);
+    out << "#include \"expression.hpp\"\n#include <chrono>\n#include <cstdio>\n\n"
+        << "using namespace parser::ex;\n\n"
+        << "int main() {\n"
+        << "    const variable<0> x{};\n    const variable<1> y{};\n    const variable<2> z{};\n"
+        << "    const auto e = " << make_expression(size) << ";\n"
+        << "    std::array<double, 3> v{ 0.5, 1.5, 2.5 };\n"
+        << "    double sum = 0;\n"
+        << "    constexpr int repeats = 100000;\n"
+        << "    const auto start = std::chrono::steady_clock::now();\n"
+        << "    for (int i = 0; i < repeats; ++i) {\n"
+        << "        v[0] += 1e-7;\n        v[1] -= 1e-7;\n        v[2] += 2e-7;\n"
+        << "        sum += e(v);\n    }\n"
+        << "    const std::chrono::duration<double, std::nano> time = std::chrono::steady_clock::now() - start;\n"
+        << "    std::printf(\"%.1f %g\\n\", time.count() / repeats, sum);\n"
+        << "}\n";
+}
+
+constexpr std::size_t rounds = 9;
+
+// CPU time of finished child processes: the compiler is waited for by the shell started by std::system.
+double children_time() {
+    rusage usage{};
+    getrusage(RUSAGE_CHILDREN, &usage);
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           1e-6 * static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
+// CPU seconds of one compilation, -1 if it fails.
+double compile(const std::string& options, const std::filesystem::path& source, const std::filesystem::path& output) {
+    const std::string command = std::string(BENCHMARK_CXX) + " -std=c++20 " + options + " -I" + BENCHMARK_INCLUDE + " " +
+                                source.string() + " -o " + output.string();
+    const double start = children_time();
+    if (std::system(command.c_str()) != 0) {
+        std::cerr << "Compilation failed: " << command << std::endl;
+        return -1;
+    }
+    return children_time() - start;
+}
+
+// Baseline and measured program are compiled in turns, so load of the machine affects both alike.
+std::optional<double> compile_time(const std::filesystem::path& source, const std::filesystem::path& binary,
+                                   const std::filesystem::path& baseline_source, const std::filesystem::path& baseline_binary) {
+    std::vector<double> differences;
+    for (std::size_t round = 0; round < rounds; ++round) {
+        const double baseline = compile("-O2", baseline_source, baseline_binary);
+        const double time = compile("-O2", source, binary);
+        if (baseline < 0 || time < 0)
+            return std::nullopt;
+        differences.push_back(time - baseline);
+    }
+    std::nth_element(differences.begin(), differences.begin() + rounds / 2, differences.end());
+    return differences[rounds / 2];
+}
+
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::size_t> sizes{100, 250, 500, 1000};
+    if (argc > 1) {
+        sizes.clear();
+        for (int i = 1; i < argc; ++i)
+            sizes.push_back(std::stoul(argv[i]));
+    }
+    const auto directory = std::filesystem::temp_directory_path() / "expression_benchmark";
+    std::filesystem::create_directories(directory);
+    const auto baseline_source = directory / "expression_0.cpp";
+    const auto baseline_binary = directory / "expression_0";
+    write_program(baseline_source, 0);
+
+    std::cout << "nodes  compile_s  debug_object_bytes  ns_per_eval" << std::endl;
+    for (const std::size_t size : sizes) {
+        const auto source = directory / ("expression_" + std::to_string(size) + ".cpp");
+        const auto binary = directory / ("expression_" + std::to_string(size));
+        const auto object = directory / ("expression_" + std::to_string(size) + ".o");
+        write_program(source, size);
+        const auto time = compile_time(source, binary, baseline_source, baseline_binary);
+        if (!time || compile("-O0 -c", source, object) < 0)
+            return 1;
+
+        double nanoseconds = 0;
+        if (FILE* run = popen(binary.c_str(), "r")) {
+            if (std::fscanf(run, "%lf", &nanoseconds) != 1)
+                nanoseconds = 0;
+            pclose(run);
+        }
+        std::printf("%5zu  %9.2f  %18ju  %11.1f\n", size, std::max(*time, 0.),
+                    static_cast<std::uintmax_t>(std::filesystem::file_size(object)), nanoseconds);
+    }
+    return 0;
+}
@@ -0,0 +1,39 @@
+#include "codegen.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <set>
+
+// Usage: FormulaCodegen <formulas file> <output header> <namespace>
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0] << " <formulas file> <output header> <namespace>" << std::endl;
+        return 2;
+    }
+    try {
+        const auto res = parser::compile_file(argv[1]);
+        parser::status st{res.diagnostics};
+        const std::string header = parser::generate_header(res.formulas, argv[3], st);
+        // formulas without variables are constants on purpose, the warning that they do not depend on variables is noise
+        std::set<std::size_t> constants;
+        for (const auto& formula : res.formulas)
+            if (formula.formula.variables_count() == 0)
+                constants.insert(formula.line);
+        for (const auto& d : st.diagnostics)
+            if (d.level == parser::diagnostic::severity::error || !constants.contains(d.line))
+                std::cerr << argv[1] << ":" << d.line << ": " << (d.level == parser::diagnostic::severity::error ? "error: " : "warning: ")
+                          << d.message << std::endl;
+        if (!st.ok())
+            return 1;
+        std::ofstream out(argv[2]);
+        out << header;
+        if (!out) {
+            std::cerr << "Can not write <" << argv[2] << ">." << std::endl;
+            return 2;
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    }
+}
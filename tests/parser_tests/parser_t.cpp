@@ -1,7 +1,21 @@
 #include "parser.hpp"
+#include "simd.hpp"
+#include "registry.hpp"
+#include "pool.hpp"
+#include "eigen.hpp"
+#include "adaptive.hpp"
+#include "binding.hpp"
+#include "bulk.hpp"
+#include "codegen.hpp"
+#include "server.hpp"
+#include "memo.hpp"
+#include "jacobian.hpp"
+#include "interval.hpp"
+#include "test_formulas.hpp"
 
 #include <numbers>
 #include <limits>
+#include <thread>
 
 #include <boost/ut.hpp>
 
@@ -43,6 +57,12 @@ const suite<"parser"> _ = [] {
                                                 int_constant<0>() + scalar<float>(1) - x + (y - y) / (z - t) + x);
         constexpr std::array<double, 9> ref{ 3, -1, 6, 0.5, 2, -7, 6, 9, 1 };
         check_result(expressions, input, ref);
+
+        // Integral constants fold at compile time, adding or multiplying by zero does not create nodes
+        static_assert(std::is_same_v<decltype(int_constant<2>() + int_constant<0>()), int_constant<2>>);
+        static_assert(std::is_same_v<decltype(int_constant<2>() * int_constant<0>()), int_constant<0>>);
+        static_assert(std::is_same_v<decltype(x + int_constant<0>()), const variable<0>&>);
+        static_assert(std::is_same_v<decltype(x * int_constant<0>()), int_constant<0>>);
     };
 
     "expression_functions"_test = [] {
@@ -56,12 +76,43 @@ const suite<"parser"> _ = [] {
         constexpr std::array<double, 10> ref{ 0, -1, 1, 1, 1, 1, 1, pi, 1, 1 };
         check_result(expressions, input, ref);
 
+        const auto fused = std::make_tuple(fma(x, y, t), hypot(t, int_constant<0>()), atan2(t, t), pow(x, int_constant<2>()), pow(t, int_constant<-3>()));
+        check_result(fused, input, std::array<double, 5>{ pi * pi / 4 - 1, 1, -3 * pi / 4, pi * pi, -1 });
+
         const auto pow_exp = pow(x, t);
         const auto res = pow_exp(input);
         const double val = std::abs(double(res) - 1. / pi);
         expect(val < std::numeric_limits<double>::epsilon());
     };
 
+    "expression_simd_batch"_test = [] {
+        variable<0> x;
+        variable<1> y;
+
+        constexpr std::size_t rows = 11;
+        std::array<double, rows> xs, ys, out;
+        for (std::size_t i = 0; i < rows; ++i) {
+            xs[i] = 0.25 * double(i) - 1.1;
+            ys[i] = 0.5 + 0.1 * double(i);
+        }
+        const std::array<std::span<const double>, 2> columns{ std::span<const double>(xs), std::span<const double>(ys) };
+
+        const auto check = [&](const auto& e) {
+            evaluate_batch(e, columns, std::span<double>(out));
+            for (std::size_t i = 0; i < rows; ++i)
+                expect(lt(std::abs(out[i] - e(std::array{ xs[i], ys[i] })), 1e-14));
+        };
+        check(x * y + int_constant<2>());
+        check(sin(x) * exp(-y) + sqrt(y) / cos(x));
+        check(sign(x) + abs(x) - ctan(y) + ex::log(y));
+        check(pow(y, x) + pow(y, scalar<double>(0.5)) + sqr(x - y));
+        check(tan(x) / int_constant<3>());
+        check(fma(x, y, int_constant<1>()) + hypot(x, y) - atan2(y, x) + pow(x, int_constant<3>()) + pow(y, int_constant<-2>()));
+
+        expect(nothrow([&] { evaluate_batch(x + y, columns, std::span<double>(out.data(), 0)); }));
+        expect(throws([&] { evaluate_batch(x + y, std::array<std::span<const double>, 2>{ std::span<const double>(xs).first(3), columns[1] }, std::span<double>(out)); }));
+    };
+
     "polish_notation_general"_test = [] {
         auto test = MathParser("x : -x");
         expect(test.to_polish() == "x~" and test.variables_count() == 1);
@@ -230,6 +281,805 @@ const suite<"parser"> _ = [] {
         expect(std::abs(test({ 2., pi, 10. }) - 9.99991) < 1e-6);
     };
 
+    "polish_notation_conditions"_test = [] {
+        auto test = MathParser("x y : x < y");
+        expect(test.to_polish() == "xy<");
+        expect(test({ 1., 2. }) == 1. and test({ 2., 2. }) == 0.);
+
+        test = MathParser("x y : (x <= y) + (x >= y) * 2 + (x == y) * 4 + (x != y) * 8 + (x > y) * 16");
+        expect(test({ 1., 1. }) == 7. and test({ 2., 1. }) == 26. and test({ 0., 1. }) == 9.);
+
+        test = MathParser("x : x + 1 < 2 * x");
+        expect(test.to_polish() == "x1+2x*<");
+        expect(test({ 2. }) == 1. and test({ 0.5 }) == 0.);
+
+        test = MathParser("x y : min(x, y) + max(x - y, -y)");
+        expect(test.to_polish() == "xyminxy-y~max+");
+        expect(test({ 3., 1. }) == 3. and test({ -1., 2. }) == -3.);
+
+        test = MathParser("x : clamp(x, -1, 1)");
+        expect(test.to_polish() == "x1~1clamp");
+        expect(test({ 5. }) == 1. and test({ -5. }) == -1. and test({ 0.5 }) == 0.5);
+
+        // piecewise function
+        test = MathParser("x : if(x < 0, -x, sqr(x)) + 1");
+        expect(test.to_polish() == "x0<x~xsqrif1+");
+        expect(test({ -2. }) == 3. and test({ 3. }) == 10.);
+
+        test = MathParser("x y : if(x, max(x, y), min(sin(x), cos(y)))");
+        expect(lt(std::abs(test({ 0., 0. }) - 0.), std::numeric_limits<double>::epsilon()));
+        expect(test({ 2., 3. }) == 3.);
+
+        expect(throws([]() { auto test = MathParser("x y : min(x)"); }));
+        expect(throws([]() { auto test = MathParser("x y : sin(x, y)"); }));
+        expect(throws([]() { auto test = MathParser("x y : (x, y)"); }));
+        expect(throws([]() { auto test = MathParser("x y : x, y"); }));
+        expect(throws([]() { auto test = MathParser("x y : x = y"); }));
+        expect(throws([]() { auto test = MathParser("x y : x ! y"); }));
+    };
+
+    "polish_notation_fused"_test = [] {
+        const auto count = [](const MathParser& parser, operator_index op) {
+            const auto& code = parser.get_program().code();
+            return std::ranges::count_if(code, [op](const instruction& ins) { return ins.op == op; });
+        };
+        auto test = MathParser("a b c : fma(a, b, c) + hypot(a, b) * atan2(b, a) - pow(c, 3)");
+        expect(test.to_polish() == "abcfmaabhypotbaatan2*+c3pow-");
+        expect(lt(std::abs(test({ 3., 4., 2. }) - (14. + 5. * std::atan2(4., 3.) - 8.)), 1e-13));
+
+        // a * b + c -> fma(a, b, c)
+        test = MathParser("x y z : x * y + z");
+        expect(count(test, operator_index::fma) == 1 and test.get_program().size() == 4);
+        expect(test({ 2., 3., 4. }) == 10.);
+        test = MathParser("x y z : z - 1 + x / 2 * y");
+        expect(count(test, operator_index::fma) == 1 and count(test, operator_index::plus) == 0);
+        expect(test({ 2., 3., 4. }) == 6.);
+
+        // constant subexpressions are folded only when integer formulas give the same result
+        test = MathParser("x : 2 * 3 + 1 + x");
+        expect(test.get_program().size() == 3u and test({ 1. }) == 8.);
+        expect(MathParser(": 2^10 - (1 < 2) + max(3, 4) * sign(-5)").get_program().size() == 1u);
+        const MathParser halves("x : x * (7 / 2 * 2)");
+        expect(halves({ 1. }) == 7. and halves({ 1 }) == 6);
+        expect(std::isinf(MathParser("x : x + 1 / 0")({ 1. })));
+
+        // sqrt(x^2 + y^2) -> hypot(x, y)
+        for (const auto& formula : { "x y : sqrt(x^2 + y^2)", "x y : sqrt(x * x + sqr(y))", "x y : sqrt(sqr(x) + y^2)" }) {
+            test = MathParser(formula);
+            expect(count(test, operator_index::hypot) == 1 and count(test, operator_index::sqrt) == 0);
+            expect(lt(std::abs(test({ 3., 4. }) - 5.), std::numeric_limits<double>::epsilon()));
+            expect(lt(std::abs(test({ 1e200, 1e200 }) - std::sqrt(2.) * 1e200), 1e185));
+        }
+
+        // integer exponents are computed by squaring, the others with std::pow
+        test = MathParser("x : x^3 + pow(x, -2) - x^(0.5)");
+        expect(count(test, operator_index::powi) == 2 and count(test, operator_index::power) == 1);
+        expect(lt(std::abs(test({ 4. }) - (64. + 1. / 16. - 2.)), std::numeric_limits<double>::epsilon() * 64));
+        // negative powers of integers go through std::pow, no integer division by the power
+        test = MathParser("x : x^-2 + x^-1");
+        expect(test({ 2 }) == 0 and test({ -1 }) == 0 and test({ 1 }) == 2);
+
+        // equal subexpressions are computed once
+        test = MathParser("x y : sin(x * y) + sin(x * y) * cos(x * y)");
+        expect(count(test, operator_index::sin) == 1 and count(test, operator_index::multiply) == 1);
+        expect(lt(std::abs(test({ 0.5, 0.7 }) - (std::sin(0.35) * (1 + std::cos(0.35)))), 1e-15));
+
+        expect(test({ 1, 2 }) == int(std::sin(2) + std::sin(2) * std::cos(2)));
+        expect(throws([]() { auto test = MathParser("x y : hypot(x)"); }));
+        expect(throws([]() { auto test = MathParser("x y z : fma(x, y)"); }));
+    };
+
+    "polish_notation_polynomials"_test = [] {
+        const auto count = [](const MathParser& parser, operator_index op) {
+            const auto& code = parser.get_program().code();
+            return std::ranges::count_if(code, [op](const instruction& ins) { return ins.op == op; });
+        };
+        const auto reference = [](const std::vector<double>& coefficients, double x) {
+            double res = 0;
+            for (std::size_t k = 0; k < coefficients.size(); ++k)
+                res += coefficients[k] * std::pow(x, double(k));
+            return res;
+        };
+        auto test = MathParser("x : 1 + 2 * x + 3 * x^2 - 4 * x^3 + 0.5 * x^4 + x^5 - 2 * x^6 + x^7 + 3 * x^8 - x^9");
+        expect(count(test, operator_index::polynomial) == 1 and count(test, operator_index::power) == 0 and count(test, operator_index::powi) == 0);
+        for (const double x : { -1.5, -0.3, 0., 0.7, 2. })
+            expect(lt(std::abs(test({ x }) - reference({ 1, 2, 3, -4, 0.5, 1, -2, 1, 3, -1 }, x)), 1e-11));
+
+        // products and powers of sums stay factored, only their sums of monomials become polynomials
+        test = MathParser("t : (t + 1) * (t^2 - 2) - sqr(t - 1)^2");
+        expect(count(test, operator_index::polynomial) == 1 and count(test, operator_index::multiply) == 1);
+        expect(lt(std::abs(test({ 3. }) - (4. * 7. - 16.)), 1e-12));
+        // near roots the factored form keeps its relative accuracy
+        test = MathParser("x : (x - 1)^10");
+        expect(count(test, operator_index::polynomial) == 0);
+        expect(lt(std::abs(test({ 1.001 }) / std::pow(1.001 - 1, 10) - 1), 1e-12));
+        test = MathParser("x : (x - 1) * (x - 1) * (x - 1) * (x - 1) * (x - 1) * (x - 1)");
+        expect(count(test, operator_index::polynomial) == 0);
+        expect(lt(std::abs(test({ 1.001 }) / std::pow(1.001 - 1, 6) - 1), 1e-12));
+        test = MathParser("x : (x^2 - 2)^3");
+        expect(lt(std::abs(test({ 1.41421356 }) / std::pow(std::fma(1.41421356, 1.41421356, -2.), 3) - 1), 1e-9));
+        // integer formulas keep their results, constants are truncated before they are combined
+        test = MathParser("x : (x + 0.5)^2");
+        expect(test({ 3 }) == 9);
+        test = MathParser("x : 0.5 * x^2 + 0.5 * x^2 + x");
+        expect(test({ 3 }) == 3 and lt(std::abs(test({ 3. }) - 12.), 1e-15));
+
+        // polynomials of different variables inside other functions
+        test = MathParser("x y : exp(x^2 - 3 * x + 1) * sin(y^3 + y) + x * y");
+        expect(count(test, operator_index::polynomial) == 2);
+        expect(lt(std::abs(test({ 0.3, 1.2 }) - (std::exp(0.09 - 0.9 + 1) * std::sin(1.728 + 1.2) + 0.36)), 1e-12));
+
+        // monomials, linear functions and divisions are left as they are
+        test = MathParser("x : x^3 + 0 * x");
+        expect(count(test, operator_index::polynomial) == 0);
+        test = MathParser("x : 2 * x + 1");
+        expect(count(test, operator_index::polynomial) == 0);
+        test = MathParser("x : x^2 / 2 + x");
+        expect(count(test, operator_index::polynomial) == 0);
+
+        std::vector<double> coefficients;
+        for (std::size_t n = 1; n <= 65; ++n) {
+            coefficients.push_back(1. / double(n) * (n % 3 == 0 ? -1. : 1.));
+            for (const double x : { -1.1, 0.4, 0.9 }) {
+                const double horner = utils::horner(coefficients.data(), n, x);
+                expect(lt(std::abs(horner - reference(coefficients, x)), 1e-12));
+                expect(lt(std::abs(utils::estrin(coefficients.data(), n, x) - horner), 1e-12));
+            }
+        }
+    };
+
+    "adaptive_evaluation"_test = [] {
+        adaptive_evaluator evaluator(MathParser("x y : sin(x) * y + x^3 - 2"), 2, 1000);
+        expect(!evaluator.choice(10).has_value());
+        std::vector<double> xs(5000), ys(5000), out(5000), reference(5000);
+        for (std::size_t i = 0; i < xs.size(); ++i) {
+            xs[i] = 0.001 * double(i);
+            ys[i] = 1. - 0.002 * double(i);
+        }
+        const std::array<std::span<const double>, 2> columns{ std::span<const double>(xs), std::span<const double>(ys) };
+        const std::span<const std::span<const double>> input(columns);
+        evaluator.formula().evaluate_batch(input, std::span<double>(reference));
+
+        // sampling on the first 1000 rows, the rest with the chosen backend
+        evaluator.evaluate(input, std::span<double>(out));
+        expect(out == reference);
+        expect(evaluator.decisions().size() == 1u and evaluator.decisions()[0].bucket == 12u and evaluator.decisions()[0].sampled_rows == 1000u);
+        const auto chosen = evaluator.choice(4100);
+        expect(chosen.has_value() and !evaluator.choice(8192).has_value());
+        for (const double time : evaluator.decisions()[0].nanoseconds_per_row)
+            expect(time > 0.);
+
+        // next batch of the bucket reuses decision
+        std::fill(out.begin(), out.end(), 0.);
+        evaluator.evaluate(input, std::span<double>(out));
+        expect(evaluator.decisions().size() == 1u and out == reference);
+        evaluator.evaluate(input.first(2), std::span<double>(out).first(7));
+        expect(evaluator.decisions().size() == 2u);
+
+        for (const backend b : { backend::interpreted, backend::batch, backend::multithreaded }) {
+            std::vector<double> res(xs.size());
+            evaluator.evaluate(b, input, std::span<double>(res));
+            expect(res == reference);
+        }
+        // large batches sample a part of their rows
+        adaptive_evaluator scaled(evaluator.formula(), 2, 100);
+        scaled.evaluate(input, std::span<double>(out));
+        expect(scaled.decisions()[0].sampled_rows == 5000u / adaptive_evaluator::sample_fraction and out == reference);
+        expect(to_string(backend::multithreaded) == "multithreaded");
+        expect(throws([&evaluator, &input]() { std::vector<double> res(6000); evaluator.evaluate(backend::interpreted, input, std::span<double>(res)); }));
+        // short columns are rejected before the sample is sliced from them
+        expect(throws([&evaluator, &input]() { std::vector<double> res(70000); evaluator.evaluate(input, std::span<double>(res)); }));
+        expect(throws([&evaluator, &input]() { std::vector<double> res(10); evaluator.evaluate(input.first(1), std::span<double>(res)); }));
+    };
+
+    "eigen_evaluation"_test = [] {
+        const auto test = MathParser("a b c : a * b - exp(-c) + hypot(a, c)");
+        Eigen::MatrixXd samples(1000, 3);
+        for (Eigen::Index i = 0; i < samples.rows(); ++i)
+            samples.row(i) << std::sin(double(i)), std::cos(double(i)), double(i % 7) * 0.1;
+        Eigen::VectorXd out(samples.rows());
+        evaluate(test, samples, out, 2);
+        bool equal = true;
+        for (Eigen::Index i = 0; i < samples.rows(); ++i)
+            equal = equal and std::abs(out[i] - test({ samples(i, 0), samples(i, 1), samples(i, 2) })) < 1e-14;
+        expect(equal);
+        expect(lt(std::abs(reduce(test, samples).sum - out.sum()), 1e-10));
+
+        // blocks of bigger matrices are used in place
+        Eigen::MatrixXd wide = Eigen::MatrixXd::Zero(1200, 5);
+        wide.block(100, 1, 1000, 3) = samples;
+        Eigen::VectorXd segment = Eigen::VectorXd::Zero(1100);
+        evaluate(test, wide.block(100, 1, 1000, 3), segment.segment(50, 1000));
+        expect(segment.segment(50, 1000) == out and segment[0] == 0.);
+
+        variable<0> a;
+        variable<1> b;
+        variable<2> c;
+        Eigen::VectorXd templated(samples.rows());
+        evaluate<3>(a * b - exp(-c) + hypot(a, c), samples, templated);
+        expect(lt((templated - out).cwiseAbs().maxCoeff(), 1e-14));
+
+        expect(throws([&test, &samples]() { Eigen::VectorXd wrong(3); evaluate(test, samples, wrong); }));
+        expect(throws([&test, &samples]() { Eigen::VectorXd wrong(samples.rows()); evaluate(test, samples.leftCols(2), wrong); }));
+    };
+
+    "grid_evaluation"_test = [] {
+        const auto test = MathParser("x y z : exp(-x^2) * cos(x) + sin(y) / (1 + x) - z * y + 3");
+        const std::vector<double> xs{ -1.5, 0., 0.5, 2. }, ys{ 0.1, 0.2, 0.3 }, zs{ -1., 1. };
+        const std::array<std::span<const double>, 3> axes{ std::span<const double>(xs), std::span<const double>(ys), std::span<const double>(zs) };
+        std::vector<double> out(xs.size() * ys.size() * zs.size());
+        test.evaluate_grid(std::span<const std::span<const double>>(axes), std::span<double>(out));
+        std::size_t position = 0;
+        for (const double x : xs)
+            for (const double y : ys)
+                for (const double z : zs)
+                    expect(lt(std::abs(out[position++] - test({ x, y, z })), 1e-15));
+
+        // instructions depending on x only are outside of y and z loops
+        const auto levels = test.get_program().levels();
+        const auto& code = test.get_program().code();
+        for (std::size_t i = 0; i < code.size(); ++i)
+            if (code[i].op == operator_index::exp || code[i].op == operator_index::cos)
+                expect(levels[i] == 1u);
+        expect(levels.back() == 3u);
+
+        const auto constant = MathParser(": 2 * 3");
+        std::array<double, 1> single{};
+        constant.evaluate_grid(std::span<const std::span<const double>>(), std::span<double>(single));
+        expect(single[0] == 6.);
+
+        expect(throws([&test, &axes]() { std::vector<double> wrong(5); test.evaluate_grid(std::span<const std::span<const double>>(axes), std::span<double>(wrong)); }));
+        expect(throws([&test, &axes]() { std::vector<double> wrong(12); test.evaluate_grid(std::span<const std::span<const double>>(axes).first(2), std::span<double>(wrong)); }));
+    };
+
+    "batch_evaluation"_test = [] {
+        const auto test = MathParser("x y : 1 + 2 * x - 3 * x^2 + x^5 + if(x < y, sin(x * y), exp(-y)) + max(x, 0.5) / (1 + y^2)");
+        constexpr std::size_t rows = 3 * batch_chunk_size + 123;
+        std::vector<double> xs(rows), ys(rows), out(rows);
+        for (std::size_t i = 0; i < rows; ++i) {
+            xs[i] = std::sin(double(i)) * 1.3;
+            ys[i] = std::cos(double(i) * 0.7);
+        }
+        const std::array<std::span<const double>, 2> columns_array{ std::span<const double>(xs), std::span<const double>(ys) };
+        const std::span<const std::span<const double>> columns(columns_array);
+
+        test.evaluate_batch(columns, std::span<double>(out), 3);
+        double sum = 0, min = std::numeric_limits<double>::max(), max = std::numeric_limits<double>::lowest();
+        bool equal = true;
+        for (std::size_t i = 0; i < rows; ++i) {
+            const double value = test({ xs[i], ys[i] });
+            equal = equal and std::abs(out[i] - value) < 1e-12;
+            sum += value;
+            min = std::min(min, value);
+            max = std::max(max, value);
+        }
+        expect(equal);
+
+        const auto statistics = test.reduce_batch(columns, rows);
+        expect(statistics.count == rows);
+        expect(lt(std::abs(statistics.sum - sum), 1e-9) and lt(std::abs(statistics.mean() - sum / rows), 1e-12));
+        expect(lt(std::abs(statistics.min - min), 1e-12) and lt(std::abs(statistics.max - max), 1e-12));
+        // bitwise equal for any number of threads
+        for (const std::size_t threads : { 2u, 3u, 8u, 0u }) {
+            const auto parallel = test.reduce_batch(columns, rows, threads);
+            expect(parallel.sum == statistics.sum and parallel.min == statistics.min and parallel.max == statistics.max);
+        }
+
+        const auto hist = test.histogram_batch(columns, rows, -2., 2., 8, 4);
+        std::size_t counted = hist.underflow + hist.overflow + hist.nan;
+        for (const std::size_t bin : hist.bins)
+            counted += bin;
+        expect(counted == rows and hist.nan == 0u);
+        std::size_t in_third_bin = 0;
+        for (const double value : out)
+            in_third_bin += (-1. <= value and value < -0.5);
+        expect(hist.bins[2] == in_third_bin);
+
+        const auto constant = MathParser(": 2 + 3");
+        expect(constant.reduce_batch(std::span<const std::span<const double>>(), 10).sum == 50.);
+        expect(throws([&test, &columns]() { test.reduce_batch(columns.first(1), 10); }));
+        expect(throws([&test, &columns]() { test.reduce_batch(columns, rows + 1); }));
+        expect(throws([&test, &columns]() { test.histogram_batch(columns, 10, 1., 1., 3); }));
+    };
+
+    "formula_registry"_test = [] {
+        formula_registry registry;
+        expect(throws([&registry]() { registry.find("f"); }));
+        const auto f = registry.publish("f", MathParser("x : x + 0"));
+        registry.publish("g", MathParser("x y : x * y"));
+        expect(registry.size() == 2 and registry.contains("g") and !registry.contains("h"));
+        expect(registry.evaluate(registry.find("g"), std::span<const double>(std::array{ 2., 3. })) == 6.);
+        {
+            const auto outer = registry.read(f);
+            const auto inner = registry.read(registry.find("g"));
+            expect(outer->variables_count() == 1 and inner->variables_count() == 2);
+        }
+
+        // readers observe every version completely and never go back, writer replaces formulas meanwhile
+        constexpr int versions = 200;
+        std::atomic<bool> stop{false};
+        std::atomic<int> errors{0};
+        std::vector<std::thread> readers;
+        for (int r = 0; r < 4; ++r) {
+            readers.emplace_back([&registry, &stop, &errors, f]() {
+                double last = 0;
+                const std::array input{ 0. };
+                while (!stop.load()) {
+                    const double res = registry.evaluate(f, std::span<const double>(input));
+                    if (res < last || res != std::trunc(res))
+                        ++errors;
+                    last = res;
+                }
+            });
+        }
+        for (int k = 1; k <= versions; ++k)
+            registry.publish("f", MathParser("x : x + " + std::to_string(k)));
+        stop = true;
+        for (auto& reader : readers)
+            reader.join();
+        expect(errors.load() == 0);
+        expect(registry.evaluate(f, std::span<const double>(std::array{ 1. })) == double(versions + 1));
+    };
+
+    "formula_pool"_test = [] {
+        const std::vector<std::string> formulas{ "x y : x + y", "x y z : x * sin(y) - z^2", "y x : y / x + 1 + 2 * x^2",
+                                                 "instrument_price strike : max(instrument_price - strike, 0)", ": 2 * 2" };
+        formula_pool pool;
+        std::vector<formula_pool::formula_id> ids;
+        for (const auto& formula : formulas)
+            ids.push_back(pool.add(MathParser(formula)));
+        expect(pool.size() == formulas.size() and pool.interned_names_count() == 5);
+        expect(pool.evaluate(ids[0], { 1., 2. }) == 3.);
+        expect(lt(std::abs(pool.evaluate(ids[1], { 2., 0.5, 3. }) - MathParser(formulas[1])({ 2., 0.5, 3. })), 1e-15));
+        expect(pool.evaluate(ids[2], { 4., 2. }) == 11.);
+        expect(pool.evaluate(ids[3], { 5., 3. }) == 2. and pool.evaluate(ids[3], { 1., 3. }) == 0.);
+        expect(pool.evaluate<double>(ids[4], {}) == 4.);
+        expect(pool.get_variables(ids[2]) == std::vector<std::string_view>{ "y", "x" });
+        expect(throws([&pool, &ids]() { pool.evaluate(ids[0], { 1. }); }));
+        expect(throws([&pool]() { pool.evaluate(formula_pool::formula_id(pool.size()), { 1. }); }));
+        // short names stay in the small string buffer
+        expect(utils::heap_size(std::string("strike")) == 0u and utils::heap_size(std::string(100, 'x')) > 100u);
+
+        // thousands of formulas share storage
+        for (int i = 0; i < 2000; ++i)
+            pool.add("x y : x * " + std::to_string(i) + " + y");
+        pool.shrink_to_fit();
+        expect(pool.evaluate(pool.size() - 1, { 2., 1. }) == 3999.);
+        const std::size_t per_formula = pool.memory_footprint() / pool.size();
+        expect(lt(per_formula, 128u));
+        expect(lt(per_formula * 4, MathParser("x y : x * 1999 + y").memory_footprint()));
+    };
+
+    "bulk_compile"_test = [] {
+        std::string text = "# formulas\n\nsum = |x y : x + y|\n|x : sqrt(x)|\r\nbad = |x : (x + 2|\nconst = |x : 2 * 2|\nx : x / 2\n";
+        for (int i = 0; i < 500; ++i)
+            text += "f" + std::to_string(i) + " = |x y : x * " + std::to_string(i) + " + y|\n";
+        text += "broken = |x : x";
+        for (const std::size_t threads : { 1u, 4u }) {
+            const bulk_result res = compile_text(text, threads);
+            expect(res.formulas.size() == 504u and res.errors == 2u and res.diagnostics.size() == 3u);
+            expect(res.formulas[0].name == "sum" and res.formulas[0].line == 3u and res.formulas[0].formula({ 1., 2. }) == 3.);
+            expect(res.formulas[1].name.empty() and res.formulas[1].formula({ 4. }) == 2.);
+            expect(res.formulas[3].formula({ 4. }) == 2.);
+            expect(res.formulas.back().name == "f499" and res.formulas.back().formula({ 2., 1. }) == 999.);
+            expect(res.diagnostics[0].line == 5u and res.diagnostics[0].level == diagnostic::severity::error);
+            expect(res.diagnostics[1].line == 6u and res.diagnostics[1].level == diagnostic::severity::warning);
+            expect(res.diagnostics[2].line == 508u and res.diagnostics[2].level == diagnostic::severity::error);
+        }
+        expect(throws([]() { compile_file("/nonexistent/formulas.txt"); }));
+    };
+
+    "bound_evaluation"_test = [] {
+        const MathParser formula("x y : x * y + sin(x) - y^2");
+        status st;
+        // caller layout differs from the order of variables and contains unused field
+        const std::array<std::string_view, 3> fields{ "id", "y", "x" };
+        auto bound = bound_formula<double>::bind(formula, fields, st);
+        expect(st.ok() and st.diagnostics.empty() and bound.valid() and bound.fields_count() == 3u);
+        static_assert(noexcept(bound(static_cast<const double*>(nullptr))));
+        const std::array<double, 6> records{ 7., 2., 3., 8., -1., 0.5 };
+        expect(bound(records.data()) == formula({ 3., 2. }));
+        std::array<double, 2> out{};
+        bound(records.data(), 3, std::span(out));
+        expect(out[0] == formula({ 3., 2. }) and out[1] == formula({ 0.5, -1. }));
+
+        struct point { double x; double weight; double y; };
+        const std::array<field<point, double>, 2> members{ { { "x", &point::x }, { "y", &point::y } } };
+        auto bound_point = bound_struct<point, double>::bind(formula, members, st);
+        expect(bound_point.valid() and bound_point(point{ 3., 10., 2. }) == formula({ 3., 2. }));
+
+        status missing;
+        const std::array<std::string_view, 2> wrong{ "x", "z" };
+        expect(not bound_formula<double>::bind(formula, wrong, missing).valid() and not missing.ok());
+        expect(missing.diagnostics.size() == 1u and missing.diagnostics[0].message.find("<y>") != std::string::npos);
+        // errors of earlier binds in a shared status do not invalidate later ones
+        expect(bound_formula<double>::bind(formula, fields, missing).valid() and missing.ok_since(1) and not missing.ok());
+        expect(std::isnan(bound_formula<double>()(records.data())) and bound_formula<int>()(nullptr) == 0);
+
+        status compile;
+        expect(not try_compile("x : (x", compile).has_value() and not compile and compile.diagnostics.size() == 1u);
+        expect(try_compile("x : 2", compile).has_value() and compile.diagnostics.size() == 2u);
+    };
+
+    "generated_formulas"_test = [] {
+        // test_formulas.hpp is generated from formulas.txt at build time
+        expect(test_formulas::formulas.size() == 6u and test_formulas::find("missing") == nullptr);
+        const std::vector<double> xs{ -2.5, -0.75, 0.5, 1., 3.25 };
+        for (const auto& generated : test_formulas::formulas) {
+            const MathParser formula(std::string(generated.source));
+            expect(formula.variables_count() == generated.variables_count);
+            std::vector<double> input(generated.variables_count);
+            for (const double x : xs) {
+                for (std::size_t k = 0; k < input.size(); ++k)
+                    input[k] = x * double(k + 1) - 0.5 * double(k);
+                expect(generated.evaluate(input) == formula(std::span<const double>(input)));
+            }
+        }
+        expect(test_formulas::call(105., 100.) == 5. and test_formulas::call(95., 100.) == 0.);
+        expect(test_formulas::constant<double>() == 7.);
+        const std::vector<double> ks{ 1., 2., 3., 4., 5. };
+        const std::array<std::span<const double>, 2> columns{ xs, ks };
+        std::vector<double> out(xs.size());
+        test_formulas::find("norm")->evaluate_batch(columns, out);
+        for (std::size_t i = 0; i < xs.size(); ++i)
+            expect(out[i] == test_formulas::norm(xs[i], ks[i]));
+        // polynomials are evaluated by the same scheme in blocks, by the interpreter and by generated code
+        const MathParser poly(std::string(test_formulas::find("poly")->source));
+        std::vector<double> points(1000), polys(points.size());
+        for (std::size_t i = 0; i < points.size(); ++i)
+            points[i] = 0.0123 * double(i) - 6.1;
+        const std::array<std::span<const double>, 1> point_columns{ points };
+        poly.evaluate_batch(std::span<const std::span<const double>>(point_columns), std::span(polys));
+        std::size_t different = 0;
+        for (std::size_t i = 0; i < points.size(); ++i)
+            different += polys[i] == poly({ points[i] }) and polys[i] == test_formulas::poly(points[i]) ? 0 : 1;
+        expect(different == 0u);
+        // pack types are accepted by generated templates as by expression templates
+        const pack<double> simd_xs(2.), simd_ys(-3.);
+        expect(test_formulas::poly(simd_xs)[0] == test_formulas::poly(2.));
+        expect(test_formulas::branches(simd_xs, simd_ys)[0] == test_formulas::branches(2., -3.));
+        expect(test_formulas::call(simd_xs, simd_ys)[0] == 5.);
+
+        status st;
+        const auto compiled = compile_text("1bad = |x : x|\nok = |x : x|\nok = |x : 2 * x|");
+        const std::string header = generate_header(compiled.formulas, "generated", st);
+        expect(st.diagnostics.size() == 2u and not st.ok() and header.find("inline T ok(const T& v0)") != std::string::npos);
+    };
+
+    "user_functions"_test = [] {
+        function_library functions;
+        functions.define("discount", "r t : exp(-r * t)");
+        functions.define("ncdf", "x : 0.5 * erfc(-x / sqrt(2))");
+        // bodies may call functions defined before
+        functions.define("dcall", "s k r t : discount(r, t) * max(s - k, 0)");
+        expect(functions.size() == 3u and functions.contains("ncdf") and functions.find("ncdf")->arity == 1u);
+
+        const MathParser price("s k r t : dcall(s, k, r, t) + ncdf(s / k - 1)", functions);
+        const MathParser expanded("s k r t : exp(-r * t) * max(s - k, 0) + 0.5 * erfc(-(s / k - 1) / sqrt(2))");
+        for (const double s : { 90., 100., 110. })
+            expect(lt(std::abs(price({ s, 100., 0.05, 2. }) - expanded({ s, 100., 0.05, 2. })), 1e-14));
+
+        // inlined bodies are optimized together with the caller: shared subexpressions are computed once
+        const MathParser twice("r t : discount(r, t) + discount(r, t)", functions);
+        const MathParser once("r t : discount(r, t)", functions);
+        expect(twice.get_program().size() == once.get_program().size() + 1);
+        // polynomial detection sees through the call
+        functions.define("square", "x : x * x");
+        const MathParser poly("x : square(x) + 2 * x + 1", functions);
+        expect(poly.get_program().size() == 2u and poly({ 3. }) == 16.);
+
+        // the formula keeps the body it was compiled with
+        functions.define("square", "x : x^2 + 1");
+        expect(poly({ 3. }) == 16. and MathParser("x : square(x)", functions)({ 3. }) == 10.);
+        // arguments used several times are shared, nested calls do not grow the tree exponentially
+        functions.define("step", "y : y * y + y");
+        functions.define("nested0", "y : step(y)");
+        for (int level = 1; level <= 40; ++level)
+            functions.define("nested" + std::to_string(level), "y : step(nested" + std::to_string(level - 1) + "(y))");
+        const MathParser nested("x : nested40(x)", functions);
+        double expected = 0.001;
+        for (int level = 0; level <= 40; ++level)
+            expected = std::fma(expected, expected, expected);
+        expect(lt(std::abs(nested({ 0.001 }) - expected), 1e-12 * expected) and nested.get_program().size() == 42u);
+        // unknown functions are reported instead of being dropped
+        expect(throws([&functions]() { MathParser("x : undefined(x)", functions); }));
+        expect(throws([]() { MathParser("x : square(x)"); }));
+        // calls with constant arguments are folded
+        functions.define("scale", "a b : a * b + 1");
+        expect(MathParser("x : scale(2, 3) * x", functions).get_program().size() == 3u);
+
+        expect(throws([&functions]() { functions.define("square", "x y : x * y"); }));
+        expect(throws([&functions]() { functions.define("sin", "x : x"); }));
+        expect(throws([&functions]() { functions.define("two", "x : 2"); functions.define("pi", ": 3.14"); }));
+        expect(throws([&functions]() { auto test = MathParser("x : discount(x)", functions); }));
+        expect(throws([&functions]() { auto test = MathParser("ncdf : ncdf + 1", functions); }));
+
+        // the library is shared by threads which compile formulas while it grows
+        std::vector<std::jthread> compilers;
+        std::atomic<int> errors{0};
+        for (int t = 0; t < 4; ++t)
+            compilers.emplace_back([&functions, &errors, t]() {
+                for (int i = 0; i < 50; ++i)
+                    if (MathParser("x : ncdf(x) + discount(x, " + std::to_string(t) + ")", functions)({ 0. }) != 1.5)
+                        ++errors;
+            });
+        for (int i = 0; i < 50; ++i)
+            functions.define("f" + std::to_string(i), "x : x + " + std::to_string(i));
+        compilers.clear();
+        expect(errors.load() == 0 and functions.size() == 98u);
+    };
+
+#if defined(__unix__) || defined(__APPLE__)
+    "batch_server"_test = [] {
+        auto compiled = compile_text("sum = |x y : x + y|\nwave = |x : sin(x) * x|");
+        const MathParser wave = compiled.formulas[1].formula;
+        const std::string path = "/tmp/parser_test_" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()) % 1000000) + ".sock";
+        batch_server server(path, std::move(compiled.formulas), 2);
+        std::jthread runner([&server]() { server.run(); });
+        {
+            batch_client client(path);
+            const served_formula sum = client.resolve("sum");
+            expect(sum.id == 0u and sum.columns == 2u and client.resolve("wave").id == 1u);
+            expect(throws([&client]() { client.resolve("missing"); }));
+
+            std::vector<double> xs(10000), ys(10000);
+            for (std::size_t i = 0; i < xs.size(); ++i) {
+                xs[i] = 0.001 * double(i);
+                ys[i] = double(i);
+            }
+            const std::array<std::span<const double>, 2> columns{ xs, ys };
+            std::vector<double> out(xs.size());
+            client.evaluate(sum.id, columns, out);
+            expect(out[0] == 0. and out[9999] == xs[9999] + 9999.);
+
+            // pipelined requests come back in order
+            const std::array<std::span<const double>, 1> x{ std::span<const double>(xs).first(100) };
+            const std::array<std::span<const double>, 1> y{ std::span<const double>(ys).first(50) };
+            client.send(1, x);
+            // wrong number of columns
+            client.send(0, x);
+            client.send(1, y);
+            std::vector<double> first(100), third(50);
+            client.receive(first);
+            expect(throws([&client, &first]() { client.receive(first); }));
+            client.receive(third);
+            expect(first[42] == wave({ xs[42] }) and third[7] == wave({ 7. }));
+
+            // the connection stays usable after errors
+            expect(throws([&client, &x, &first]() { client.evaluate(7, x, first); }));
+            client.evaluate(1, x, first);
+            expect(first[99] == wave({ xs[99] }));
+            // oversized batches are rejected by the client before they are sent
+            const std::vector<double> huge(protocol::max_request_rows + 1);
+            const std::array<std::span<const double>, 1> huge_column{ huge };
+            expect(throws([&client, &huge_column]() { client.send(1, huge_column); }));
+
+            const server_statistics stats = client.statistics();
+            expect(stats.requests == 9u and stats.errors == 3u and stats.rows == 10000u + 100 * 2 + 50);
+            expect(stats.mean_latency_us() > 0. and stats.latency_quantile_us(1.) >= stats.latency_quantile_us(0.5));
+
+            // many short connections, threads of closed ones are joined while the server runs
+            for (int k = 0; k < 50; ++k)
+                expect(batch_client(path).resolve("wave").id == 1u);
+        }
+        server.stop();
+        runner.join();
+        expect(server.statistics().requests == 59u);
+        expect(throws([&path]() { batch_client client(path + ".missing"); }));
+    };
+#endif
+
+    "memo_cache"_test = [] {
+        const MathParser heavy("x y : tgamma(x) * erf(y) + pow(x, y)");
+        const MathParser cheap("x y : x * y + 1");
+        expect(heavy.get_program().estimated_cost() >= default_memo_min_cost and cheap.get_program().estimated_cost() < default_memo_min_cost);
+
+        memo_cache<double> cache(heavy, 64);
+        expect(cache.enabled());
+        for (int repeat = 0; repeat < 10; ++repeat)
+            for (int i = 0; i < 20; ++i)
+                expect(cache({ 1. + 0.1 * i, 0.5 }) == heavy({ 1. + 0.1 * i, 0.5 }));
+        expect(cache.statistics().misses == 20u and cache.statistics().hits == 180u and cache.statistics().hit_rate() == 0.9);
+        // keys are bit patterns
+        const MathParser signed_zero("x : 1 / x + tgamma(x + 1)");
+        memo_cache<double> zeros(signed_zero, 8);
+        expect(zeros({ 0. }) > 0. and zeros({ -0. }) < 0.);
+        // values must fit the hash word, long double has padding bytes
+        static_assert(memo_key<float> and memo_key<int> and not memo_key<long double>);
+        memo_cache<float> floats(heavy, 8);
+        expect(floats({ 2.5f, 0.5f }) == floats({ 2.5f, 0.5f }) and floats.statistics().hits == 1u);
+        // the table is bounded, evicted entries are computed again
+        memo_cache<double> small(heavy, 4);
+        for (int i = 0; i < 1000; ++i)
+            expect(small({ double(i % 100) + 0.5, 1. }) == heavy({ double(i % 100) + 0.5, 1. }));
+        expect(lt(small.statistics().hits, 500u));
+        small.clear();
+        expect(small.statistics().misses == 0u);
+
+        memo_cache<double> bypass(cheap);
+        expect(not bypass.enabled() and bypass({ 2., 3. }) == 7. and bypass.statistics().bypassed == 1u);
+        expect(throws([&cache]() { cache({ 1. }); }));
+
+        concurrent_memo_cache<double> shared(heavy, 1024);
+        std::atomic<int> errors{0};
+        {
+            std::vector<std::jthread> threads;
+            for (int t = 0; t < 4; ++t)
+                threads.emplace_back([&shared, &heavy, &errors]() {
+                    for (int i = 0; i < 2000; ++i)
+                        if (shared({ 1. + 0.01 * (i % 50), 0.25 }) != heavy({ 1. + 0.01 * (i % 50), 0.25 }))
+                            ++errors;
+                });
+        }
+        const memo_statistics stats = shared.statistics();
+        expect(errors.load() == 0 and stats.hits + stats.misses == 8000u and stats.hit_rate() > 0.9);
+    };
+
+    "sparse_jacobian"_test = [] {
+        // forward mode derivatives of all functions against central differences
+        const std::vector<std::pair<std::string, double>> functions{
+            { "x : x^3 / (1 + x)", 0.7 }, { "x : sqrt(x) + cbrt(x)", 0.7 }, { "x : sin(x) * cos(x) + tan(x)", 0.7 },
+            { "x : asin(x) + acos(x) / 2 + atan(x)", 0.3 }, { "x : sinh(x) + cosh(x) + tanh(x)", 0.7 },
+            { "x : asinh(x) + acosh(x + 1) + atanh(x / 2)", 0.7 }, { "x : exp(x) + exp2(x) + expm1(x)", 0.7 },
+            { "x : log(x) + log10(x) + log2(x) + log1p(x)", 0.7 }, { "x : abs(-x) * sign(x) + floor(x) + round(x)", 0.7 },
+            { "x : tgamma(x) + lgamma(x)", 2.3 }, { "x : tgamma(x)", -1.5 }, { "x : erf(x) + erfc(x / 2)", 0.7 },
+            { "x : pow(x, x) + pow(2, x) + x^2.5", 0.7 }, { "x : hypot(x, 2) + atan2(x, 2) + atan2(2, x)", 0.7 },
+            { "x : fma(x, x, x) + min(x, 1) + max(sqr(x), 2) + clamp(x, 0, 0.5)", 0.7 },
+            { "x : if(x < 1, x^5, -x) + 1 + 2 * x + 3 * x^2", 0.7 }};
+        std::size_t wrong = 0;
+        for (const auto& [source, x] : functions) {
+            const MathParser f(source);
+            const formula_system system({ "x" }, { f });
+            std::array<double, 1> value{};
+            system.jacobian(std::array{ x }, value);
+            const double h = 1e-6;
+            const double difference = (f({ x + h }) - f({ x - h })) / (2 * h);
+            wrong += std::abs(value[0] - difference) < 1e-6 * std::max(1., std::abs(difference)) ? 0 : 1;
+        }
+        expect(wrong == 0u);
+
+        // infinite slope at the edge of the domain of y does not spoil derivatives along x
+        const formula_system edge({ "x", "y" }, { MathParser("x y : sqrt(y) + x"), MathParser("x y : log(y) * 0 + x * y"),
+                                                  MathParser("x y : asin(y + 1) + acosh(y + 1) + cbrt(y) + tgamma(y) + hypot(y, 0) + x") });
+        std::vector<double> edge_values(edge.nonzeros());
+        edge.jacobian(std::array{ 1., 0. }, edge_values);
+        expect(edge_values[0] == 1. and edge_values[1] == std::numeric_limits<double>::infinity() and edge_values[2] == 0. and
+               edge_values[4] == 1.);
+
+        // Broyden tridiagonal system, three colors for any size
+        const std::size_t n = 50;
+        std::vector<std::string> variables;
+        for (std::size_t i = 0; i < n; ++i)
+            variables.push_back("x" + std::to_string(i));
+        std::vector<MathParser> formulas;
+        for (std::size_t i = 0; i < n; ++i) {
+            const std::string left = i > 0 ? variables[i - 1] : "", right = i + 1 < n ? variables[i + 1] : "";
+            formulas.emplace_back(left + " " + variables[i] + " " + right + " : (3 - 2 * " + variables[i] + ") * " + variables[i] +
+                                  (i > 0 ? " - " + left : "") + (i + 1 < n ? " - 2 * " + right : "") + " + 1");
+        }
+        const formula_system system(variables, formulas);
+        expect(system.rows() == n and system.columns() == n and system.nonzeros() == 3 * n - 2 and system.colors_count() == 3u);
+        std::vector<double> x(n), values(system.nonzeros());
+        for (std::size_t i = 0; i < n; ++i)
+            x[i] = 0.1 * double(i) - 1;
+        system.jacobian(x, values);
+        const auto& offsets = system.row_offsets();
+        const auto& columns = system.column_indices();
+        bool exact = true;
+        for (std::size_t i = 0; i < n; ++i)
+            for (std::size_t k = offsets[i]; k < offsets[i + 1]; ++k) {
+                const std::size_t j = columns[k];
+                const double expected = j == i ? 3 - 4 * x[i] : j + 1 == i ? -1. : -2.;
+                exact = exact and (j + 1 == i or j == i or j == i + 1) and std::abs(values[k] - expected) < 1e-14;
+            }
+        expect(exact);
+        std::vector<double> residuals(n);
+        system.evaluate(x, residuals);
+        expect(std::abs(residuals[0] - ((3 - 2 * x[0]) * x[0] - 2 * x[1] + 1)) < 1e-14);
+
+        // batch reuses the pattern, every point gives the same values as a single evaluation
+        const std::size_t points = 100;
+        std::vector<double> batch_points(points * n), batch_values(points * system.nonzeros());
+        for (std::size_t k = 0; k < batch_points.size(); ++k)
+            batch_points[k] = std::sin(double(k));
+        system.jacobian_batch(batch_points, batch_values, 2);
+        bool same = true;
+        for (std::size_t p = 0; p < points; ++p) {
+            system.jacobian(std::span<const double>(batch_points).subspan(p * n, n), values);
+            same = same and std::equal(values.begin(), values.end(), batch_values.begin() + p * system.nonzeros());
+        }
+        expect(same);
+
+        expect(throws([] { formula_system({ "x" }, { MathParser("x y : x * y") }); }));
+        expect(throws([] { formula_system({ "x", "x" }, { MathParser("x : x") }); }));
+        expect(throws([&system] { std::vector<double> v(system.nonzeros()); system.jacobian(std::array{ 1. }, v); }));
+    };
+
+    "interval_evaluation"_test = [] {
+        using range = interval<double>;
+        // every point of a box is inside the bounds of the box
+        const std::vector<std::string> sources{
+            "x y : x * y - x / (y + 3) + sqr(x - y)", "x y : x^3 - 2 * x^2 + y^4 + x^-2", "x y : sqrt(abs(x)) + cbrt(y) + hypot(x, y)",
+            "x y : sin(x * y) + cos(x) * tan(y)", "x y : asin(x / 4) + acos(y / 4) + atan(x) + atan2(y, x)",
+            "x y : sinh(x) + cosh(y) + tanh(x * y) + asinh(y) + acosh(abs(x) + 1) + atanh(y / 4)",
+            "x y : exp(x) + exp2(y) + expm1(x * y) + log(abs(x) + 0.1) + log10(abs(y) + 1) + log2(x^2 + 1) + log1p(abs(y))",
+            "x y : sign(x) + ceil(y) + floor(x) + trunc(y) + round(x * y)", "x y : tgamma(x) + lgamma(y)", "x y : tgamma(x - 3)",
+            "x y : erf(x) + erfc(y) + pow(abs(x) + 0.5, y) + pow(x, 3)", "x y : pow(x, round(y)) + pow(x - 5, round(y * 3))", "x y : fma(x, y, 1) + 1 + 2 * x + 3 * x^2 - 4 * x^3",
+            "x y : if(x < y, x, y^2) + min(x, y) + max(x, y) + clamp(x, -1, 1) + (x <= y) + (x == y) + (x != y) + (x >= 0)"};
+        std::uint64_t state = 7;
+        const auto uniform = [&state](double lower, double upper) {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            return lower + (upper - lower) * double(state >> 11) / double(1ull << 53);
+        };
+        std::size_t outside = 0;
+        for (const std::string& source : sources) {
+            const MathParser f(source);
+            for (int b = 0; b < 200; ++b) {
+                const double x = uniform(-4, 4), y = uniform(-4, 4), w = uniform(0, b % 2 == 0 ? 0.1 : 3);
+                const std::array<range, 2> box{ range(x, x + w), range(y, y + w / 2) };
+                const range bounds = bound(f, std::span<const range>(box));
+                for (int k = 0; k < 50; ++k) {
+                    const double value = f({ uniform(x, x + w), uniform(y, y + w / 2) });
+                    if (value == value and not (bounds.lower <= value and value <= bounds.upper))
+                        ++outside;
+                }
+            }
+        }
+        expect(outside == 0u);
+
+        // extrema inside the box are taken into account, dependent factors are not multiplied
+        const auto bound_of = [](const std::string& source, range x) { return bound(MathParser(source), std::span<const range>(&x, 1)); };
+        const range square = bound_of("x : x^2", range(-1, 2));
+        expect(square.lower == 0. and square.upper >= 4. and square.upper < 4. + 1e-12);
+        const range sine = bound_of("x : sin(x)", range(0, 3));
+        expect(sine.upper == 1. and sine.lower <= 0. and sine.lower > -1e-300);
+        const range gamma = bound_of("x : tgamma(x)", range(1, 3));
+        expect(gamma.lower < 0.8856031944108887 and gamma.lower > 0.885603194 and gamma.upper >= 2.);
+        expect(bound_of("x : tan(x)", range(1, 2)).upper == std::numeric_limits<double>::infinity());
+        expect(bound_of("x : tgamma(x)", range(-1.5, -0.5)).lower == -std::numeric_limits<double>::infinity());
+        const range branch = bound_of("x : if(x < 0, -x, x + 10)", range(1, 2));
+        expect(branch.lower > 10.9 and branch.upper < 12.1);
+        const range root = bound_of("x : sqrt(x)", range(-1, 4));
+        expect(root.lower == 0. and root.upper >= 2. and root.upper < 2. + 1e-12);
+        expect(bound_of("x : sqrt(x)", range(-2, -1)).empty());
+        // negative base has real powers at integer exponents of the range only
+        const auto power_of = [](range x, range y) {
+            const std::array<range, 2> box{ x, y };
+            return bound(MathParser("x y : x^y"), std::span<const range>(box));
+        };
+        const range negative = power_of(range(-2, -1), range(2, 3));
+        expect(negative.lower <= -8. and negative.lower > -8.001 and negative.upper >= 4. and negative.upper < 4.001);
+        expect(power_of(range(-2, -1), range(2.2, 2.8)).empty());
+        const range wide = power_of(range(-2, 1), range(0.5, 10));
+        expect(wide.lower <= -512. and wide.upper >= 1024. and wide.upper < 1025.);
+
+        // expression templates accept intervals as well
+        const variable<0> x;
+        const std::array<range, 1> box{ range(-1, 2) };
+        const range templated = (sqr(x) + sin(x) * scalar<double>(0.5))(box);
+        const range compiled = bound_of("x : x^2 + sin(x) * 0.5", box[0]);
+        expect(templated.lower <= -0.42 and templated.upper >= 4.45 and std::abs(templated.lower - compiled.lower) < 1e-12);
+
+        // many boxes at once
+        const MathParser f("x y : exp(-x^2) * cos(y)");
+        const std::size_t boxes = 5000;
+        std::vector<range> xs(boxes), ys(boxes), out(boxes);
+        for (std::size_t i = 0; i < boxes; ++i) {
+            xs[i] = range(0.001 * double(i), 0.001 * double(i) + 0.01);
+            ys[i] = range(-0.002 * double(i), 1 - 0.002 * double(i));
+        }
+        const std::array<std::span<const range>, 2> columns{ xs, ys };
+        bound_batch(f, std::span<const std::span<const range>>(columns), std::span(out), 2);
+        bool same = true;
+        for (std::size_t i = 0; i < boxes; ++i) {
+            const std::array<range, 2> single{ xs[i], ys[i] };
+            const range expected = bound(f, std::span<const range>(single));
+            same = same and expected.lower == out[i].lower and expected.upper == out[i].upper;
+        }
+        expect(same);
+        expect(throws([&f] { bound(f, std::span<const range>()); }));
+    };
+
     "polish_notation_throws"_test = [] {
         using namespace std::string_literals;
         static const std::unordered_map<std::string, std::size_t> operator_priority{{"("s, 0}, {"+"s, 1}, {"-"s, 1}, {"*"s, 2},
@@ -241,7 +1091,9 @@ const suite<"parser"> _ = [] {
                                                                                     {"asin"s, 4}, {"acos"s, 4}, {"sinh"s, 4}, {"cosh"s, 4},
                                                                                     {"tanh"s, 4}, {"asinh"s, 4}, {"acosh"s, 4}, {"atanh"s, 4},
                                                                                     {"erf"s, 4}, {"erfc"s, 4}, {"lgamma"s, 4}, {"ceil"s, 4},
-                                                                                    {"floor"s, 4}, {"round"s, 4}, {"trunc"s, 4}};
+                                                                                    {"floor"s, 4}, {"round"s, 4}, {"trunc"s, 4}, {"if"s, 4},
+                                                                                    {"min"s, 4}, {"max"s, 4}, {"clamp"s, 4}, {"fma"s, 4},
+                                                                                    {"hypot"s, 4}, {"atan2"s, 4}, {"pow"s, 4}};
         // Wrong variables format. Symbol ':' is required after variables initialization.
         expect(throws([]() { auto test = MathParser("x y z x * y * z"s); }));
 
@@ -255,6 +1107,7 @@ const suite<"parser"> _ = [] {
         // Everything alright. Variables are not required if not used.
         expect(nothrow([]() { auto test = MathParser(": 2 * 2"s); }));
         expect(nothrow([]() { auto test = MathParser("x : 2 * 2"s); }));
+        expect(MathParser("x : 2 * 2"s).warnings().size() == 1u and MathParser("x : 2 * x"s).warnings().empty());
 
         // TODO : implement verification for this case, when variable in infix notation is not used 
         auto test = MathParser("x : 2 * 2 * y"s);